@@ -0,0 +1,57 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+/**
+ * A guest basic block translated to C by the recompile tool.
+ */
+typedef struct Chip8AotBlock {
+	uint16_t address;
+	uint16_t length;
+	void (*code)(Chip8*);
+} Chip8AotBlock;
+
+/**
+ * Everything a recompiled ROM exports, under the name chip8_aot_program.
+ */
+typedef struct Chip8AotProgram {
+	const uint8_t* rom;
+	uint16_t rom_size;
+	const Chip8AotBlock* blocks;
+	uint16_t block_count;
+} Chip8AotProgram;
+
+/**
+ * @brief Load a ROM recompiled ahead of time.
+ *
+ * The library is a shared object built from the output of the recompile tool.
+ * Its blocks are used by run() when chip->engine is CHIP8_ENGINE_AOT.
+ *
+ * @param chip State of the chip8 CPU.
+ * @param library_name Path of the shared object.
+ * @return 0 on success, -1 if the library could not be loaded.
+ */
+int load_aot(Chip8* chip, char* library_name);
+
+/**
+ * @brief Execute count instructions with the recompiled blocks.
+ *
+ * A block only runs while the memory it was translated from still holds the
+ * original ROM bytes. Addresses without a block, modified code and blocks
+ * longer than the instructions left fall back to cycle(). The results are the
+ * same as calling cycle() count times.
+ *
+ * @param chip State of the chip8 CPU.
+ * @param count Number of instructions to execute.
+ */
+void run_aot(Chip8* chip, uint32_t count);
+
+/**
+ * @brief Unload the recompiled ROM of a chip.
+ *
+ * @param aot Loaded program state, may be NULL.
+ */
+void aot_destroy(struct Chip8Aot* aot);
+
+#endif /* AOT_H */
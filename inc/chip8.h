@@ -1,9 +1,13 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "isa.h"
 
 #define CHIP8_MEMORY_SIZE 4096
+// Guest addresses wrap around the end of memory.
+#define CHIP8_ADDRESS_MASK (CHIP8_MEMORY_SIZE - 1)
 #define CHIP8_SCREEN_WIDTH 64
 #define CHIP8_SCREEN_HEIGHT 32
 #define CHIP8_PIXEL_COUNT (CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_HEIGHT)
@@ -11,6 +15,76 @@
 #define CHIP8_STACK_SIZE 16
 #define CHIP8_REGISTER_COUNT 16
 #define CHIP8_FONT_SET_START_ADDRESS 0x0050
+#define CHIP8_ROM_START_ADDRESS 0x0200
+#define CHIP8_PIXEL_ON 0xffffffff
+#define CHIP8_INSTRUCTIONS_PER_TICK 10
+#define CHIP8_PAGE_SIZE 256
+#define CHIP8_PAGE_COUNT (CHIP8_MEMORY_SIZE / CHIP8_PAGE_SIZE)
+
+#define CHIP8_FUSED_MAX_LENGTH 3
+
+struct Chip8;
+struct Chip8Instruction;
+
+typedef void (*Chip8Handler)(struct Chip8*, const struct Chip8Instruction*);
+typedef uint32_t (*Chip8FusedHandler)(struct Chip8*, const struct Chip8Instruction*, uint32_t);
+
+typedef enum Chip8Op {
+	CHIP8_OP_NULL,
+#define CHIP8_OP_ENUM(OP, handler, mask, pattern, syntax) CHIP8_OP_##OP,
+	CHIP8_ISA(CHIP8_OP_ENUM)
+#undef CHIP8_OP_ENUM
+	CHIP8_OP_COUNT
+} Chip8Op;
+
+/**
+ * Why a call failed. Calls that can fail return CHIP8_OK or one of these,
+ * all negative, and leave the process running, so a host can keep many
+ * chips in one process and handle a failure of one of them.
+ */
+typedef enum Chip8Error {
+	CHIP8_OK = 0,
+	CHIP8_ERROR_OUT_OF_MEMORY = -1,
+	CHIP8_ERROR_OPEN_FILE = -2,
+	CHIP8_ERROR_READ_FILE = -3,
+	CHIP8_ERROR_WRITE_FILE = -4
+} Chip8Error;
+
+/**
+ * Which loop executes instructions when calling run().
+ */
+typedef enum Chip8Engine {
+	CHIP8_ENGINE_TABLE,
+	CHIP8_ENGINE_THREADED,
+	CHIP8_ENGINE_JIT,
+	CHIP8_ENGINE_AOT,
+	CHIP8_ENGINE_FLAT
+} Chip8Engine;
+
+/**
+ * An instruction as it was decoded from memory: the final handler, with no
+ * intermediate dispatch tables, and its operands already extracted from the
+ * opcode. The handler is given the instruction and reads its operands from
+ * there.
+ *
+ * When it starts a common sequence of instructions, fused runs the whole
+ * sequence, whose following opcodes are kept in next_opcodes, and returns how
+ * many instructions it executed. It is given a budget of at least
+ * CHIP8_FUSED_MAX_LENGTH instructions. When the sequence is an idle loop, it
+ * may use the whole budget at once.
+ */
+typedef struct Chip8Instruction {
+	Chip8Handler handler;
+	Chip8FusedHandler fused;
+	uint16_t opcode;
+	uint16_t nnn;
+	uint16_t next_opcodes[CHIP8_FUSED_MAX_LENGTH - 1];
+	uint8_t x;
+	uint8_t y;
+	uint8_t kk;
+	uint8_t n;
+	uint8_t op;
+} Chip8Instruction;
 
 typedef struct Chip8 {
 	uint8_t registers[CHIP8_REGISTER_COUNT];
@@ -22,15 +96,67 @@ typedef struct Chip8 {
 	uint8_t delay_timer;
 	uint8_t sound_timer;
 	uint8_t keypad[CHIP8_KEYPAD_SIZE];
-	uint32_t video[CHIP8_PIXEL_COUNT];
+	// Set while fx0a waits for a key. pc stays on the fx0a, which runs again
+	// until a key is pressed.
+	uint8_t waiting_for_key;
+	// One bit per pixel, one word per row, the leftmost pixel in the most
+	// significant bit.
+	uint64_t video[CHIP8_SCREEN_HEIGHT];
+	// Bit n is set when row n of video changed since the frontend last
+	// cleared it.
+	uint32_t dirty_rows;
 	uint16_t opcode;
+	// The timers tick at 60 Hz of guest time: once every instructions_per_tick
+	// executed instructions. They are only brought up to date by
+	// update_timers().
+	uint64_t instruction_count;
+	uint64_t timers_updated_at;
+	uint16_t instructions_per_tick;
+	uint64_t random_state;
+	uint8_t engine;
+	// Everything above is the machine, copied as a whole by chip8_reset() and
+	// saved by chip8_save_state(). Bump CHIP8_STATE_VERSION when it changes.
+	// Everything below is derived from it or belongs to this chip only.
+	uint32_t page_version[CHIP8_PAGE_COUNT];
+	// Tells chips apart for chip8_clone(). 0 for a chip that was not made by
+	// create() or chip8_reset().
+	uint64_t id;
+	// Bytes read into memory by the last load_rom().
+	uint16_t rom_size;
+	// The chip last cloned into this one, and the versions of its pages and
+	// of the pages of this one right after, when both memories were the same.
+	uint64_t clone_parent;
+	uint32_t clone_parent_version[CHIP8_PAGE_COUNT];
+	uint32_t clone_version[CHIP8_PAGE_COUNT];
+	Chip8Instruction decoded[CHIP8_MEMORY_SIZE];
+	struct Chip8Jit* jit;
+	struct Chip8Aot* aot;
 } Chip8;
 
+#define CHIP8_MACHINE_SIZE offsetof(Chip8, page_version)
+
 Chip8* create(void);
-void load_rom(Chip8* chip, char* rom_name);
-void dump_memory_to_file(Chip8* chip, char* memory_file_name);
+Chip8Error load_rom(Chip8* chip, char* rom_name);
+Chip8Error dump_memory_to_file(Chip8* chip, char* memory_file_name);
+const char* chip8_strerror(Chip8Error error);
 void cycle(Chip8* chip);
+void run(Chip8* chip, uint32_t count);
+Chip8Op identify(uint16_t opcode);
+void disassemble(uint16_t opcode, char* text, size_t size);
+void decode_operands(uint16_t opcode, Chip8Instruction* instruction);
+void decode(Chip8* chip, uint16_t address, Chip8Instruction* instruction);
+void decode_past_memory(Chip8* chip, Chip8Instruction* instruction);
+void invalidate_decoded(Chip8* chip, uint16_t address, uint16_t length);
+void update_timers(Chip8* chip);
+int ends_block(uint8_t op);
+int is_halted(Chip8* chip);
+void expand_video(Chip8* chip, uint32_t* pixels);
 void destroy(Chip8* chip);
-uint8_t generate_random_byte(void);
+void chip8_reset(Chip8* chip, const Chip8* pristine);
+void load_machine(Chip8* chip, const uint8_t* machine);
+void chip8_clone(Chip8* child, const Chip8* parent);
+void seed_random(Chip8* chip, uint64_t seed);
+uint8_t generate_random_byte(Chip8* chip);
+uint8_t next_random_byte(uint64_t* random_state);
 
 #endif /* CHIP8_H */
@@ -0,0 +1,82 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "chip8.h"
+
+#define CHIP8_FRAME_COUNT 3
+
+/**
+ * A frame as the display shows it, one RGBA pixel per chip8 pixel.
+ */
+typedef struct Chip8Frame {
+	uint32_t pixels[CHIP8_PIXEL_COUNT];
+	// Rows that changed since the frame published before this one, or every
+	// row when the reader missed that frame.
+	uint32_t dirty_rows;
+	uint64_t sequence;
+} Chip8Frame;
+
+/**
+ * A lock-free triple buffer handing frames from the thread that emulates to
+ * the thread that draws them. Neither side ever waits for the other: the
+ * writer always has a frame of its own to fill, and the reader always gets
+ * the newest published frame, skipping the ones it was too slow for.
+ */
+typedef struct Chip8Frames {
+	Chip8Frame frames[CHIP8_FRAME_COUNT];
+	// Index of the frame between the two threads, with CHIP8_FRAME_FRESH set
+	// until the reader takes it.
+	_Atomic uint8_t handover;
+	// Only used by the writer.
+	uint8_t back;
+	uint64_t published;
+	// Only used by the reader.
+	uint8_t front;
+	uint64_t taken;
+} Chip8Frames;
+
+/**
+ * @brief Start with no frame published.
+ *
+ * @param frames Triple buffer to initialize.
+ */
+void frames_init(Chip8Frames* frames);
+
+/**
+ * @brief Get the frame the writer fills next. It stays the writer's until it
+ * is published.
+ *
+ * @param frames Triple buffer.
+ * @return Frame to fill.
+ */
+Chip8Frame* frames_back(Chip8Frames* frames);
+
+/**
+ * @brief Hand the back frame over to the reader and take another one to fill.
+ *
+ * @param frames Triple buffer.
+ */
+void frames_publish(Chip8Frames* frames);
+
+/**
+ * @brief Expand the video of a chip into the back frame and publish it.
+ *
+ * The dirty rows of the chip move to the frame.
+ *
+ * @param frames Triple buffer.
+ * @param chip Chip to copy the video from.
+ */
+void publish_video(Chip8Frames* frames, Chip8* chip);
+
+/**
+ * @brief Take the newest published frame. It stays the reader's until the next
+ * call.
+ *
+ * @param frames Triple buffer.
+ * @return The frame, or NULL if nothing was published since the last call.
+ */
+Chip8Frame* frames_take(Chip8Frames* frames);
+
+#endif /* FRAMES_H */
@@ -3,6 +3,17 @@
 
 #include "chip8.h"
 
+/**
+ * @brief Execute an opcode that is not part of the instruction set.
+ *
+ * The opcode is skipped like a no-op, so that data mixed into a program does
+ * not stop it.
+ *
+ * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
+ */
+void op_invalid(Chip8* chip, const Chip8Instruction* instruction);
+
 /**
  * @name 00E0
  * @brief Clear the display.
@@ -10,8 +21,9 @@
  * @verbatim CLS @endverbatim
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_00e0(Chip8* chip);
+void op_00e0(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 00EE
@@ -23,8 +35,9 @@ void op_00e0(Chip8* chip);
  * stack, then subtracts 1 from the stack pointer.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_00ee(Chip8* chip);
+void op_00ee(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 1nnn
@@ -35,8 +48,9 @@ void op_00ee(Chip8* chip);
  * The interpreter sets the program counter to nnn.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_1nnn(Chip8* chip);
+void op_1nnn(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 2nnn
@@ -48,8 +62,9 @@ void op_1nnn(Chip8* chip);
  * top of the stack. The PC is then set to nnn.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_2nnn(Chip8* chip);
+void op_2nnn(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 3xkk
@@ -61,8 +76,9 @@ void op_2nnn(Chip8* chip);
  * the program counter by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_3xkk(Chip8* chip);
+void op_3xkk(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 4xkk
@@ -74,8 +90,9 @@ void op_3xkk(Chip8* chip);
  * increments the program counter by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_4xkk(Chip8* chip);
+void op_4xkk(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  *
@@ -88,8 +105,9 @@ void op_4xkk(Chip8* chip);
  * increments the program counter by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_5xy0(Chip8* chip);
+void op_5xy0(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 6xkk
@@ -100,8 +118,9 @@ void op_5xy0(Chip8* chip);
  * The interpreter puts the value kk into register Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_6xkk(Chip8* chip);
+void op_6xkk(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 7xkk
@@ -112,8 +131,9 @@ void op_6xkk(Chip8* chip);
  * Adds the value kk to the value of register Vx, then stores the result in Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_7xkk(Chip8* chip);
+void op_7xkk(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy0
@@ -124,8 +144,9 @@ void op_7xkk(Chip8* chip);
  * Stores the value of register Vy in register Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy0(Chip8* chip);
+void op_8xy0(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy1
@@ -139,8 +160,9 @@ void op_8xy0(Chip8* chip);
  * 0.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy1(Chip8* chip);
+void op_8xy1(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy2
@@ -154,8 +176,9 @@ void op_8xy1(Chip8* chip);
  * 0.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy2(Chip8* chip);
+void op_8xy2(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy3
@@ -169,8 +192,9 @@ void op_8xy2(Chip8* chip);
  * the result is set to 1. Otherwise, it is 0.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy3(Chip8* chip);
+void op_8xy3(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy4
@@ -183,8 +207,9 @@ void op_8xy3(Chip8* chip);
  * the result are kept, and stored in Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy4(Chip8* chip);
+void op_8xy4(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy5
@@ -196,8 +221,9 @@ void op_8xy4(Chip8* chip);
  * and the results stored in Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy5(Chip8* chip);
+void op_8xy5(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy6
@@ -209,8 +235,9 @@ void op_8xy5(Chip8* chip);
  * Then Vx is divided by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy6(Chip8* chip);
+void op_8xy6(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xy7
@@ -222,8 +249,9 @@ void op_8xy6(Chip8* chip);
  * and the results stored in Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xy7(Chip8* chip);
+void op_8xy7(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 8xyE
@@ -235,8 +263,9 @@ void op_8xy7(Chip8* chip);
  * Then Vx is multiplied by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_8xye(Chip8* chip);
+void op_8xye(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name 9xy0
@@ -248,8 +277,9 @@ void op_8xye(Chip8* chip);
  * counter is increased by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_9xy0(Chip8* chip);
+void op_9xy0(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Annn
@@ -260,8 +290,9 @@ void op_9xy0(Chip8* chip);
  * The value of register I is set to nnn.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_annn(Chip8* chip);
+void op_annn(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Bnnn
@@ -271,8 +302,9 @@ void op_annn(Chip8* chip);
  *
  * The program counter is set to nnn plus the value of V0.
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_bnnn(Chip8* chip);
+void op_bnnn(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Cxkk
@@ -284,10 +316,11 @@ void op_bnnn(Chip8* chip);
  * with the value kk. The results are stored in Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  * @param byte_generator_function Function to generate a random number between 0
- * and 255.
+ * and 255 for the given chip.
  */
-void op_cxkk(Chip8* chip, uint8_t (*byte_generator_function)());
+void op_cxkk(Chip8* chip, const Chip8Instruction* instruction, uint8_t (*byte_generator_function)(Chip8*));
 
 /**
  * @name Dxyn
@@ -304,8 +337,9 @@ void op_cxkk(Chip8* chip, uint8_t (*byte_generator_function)());
  * around to the opposite side of the screen.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_dxyn(Chip8* chip);
+void op_dxyn(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Ex9E
@@ -317,8 +351,9 @@ void op_dxyn(Chip8* chip);
  * currently in the down position, PC is increased by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_ex9e(Chip8* chip);
+void op_ex9e(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name ExA1
@@ -330,8 +365,9 @@ void op_ex9e(Chip8* chip);
  * currently in the up position, PC is increased by 2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_exa1(Chip8* chip);
+void op_exa1(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx07
@@ -342,8 +378,9 @@ void op_exa1(Chip8* chip);
  * The value of DT is placed into Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx07(Chip8* chip);
+void op_fx07(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx0A
@@ -352,11 +389,13 @@ void op_fx07(Chip8* chip);
  * @verbatim LD Vx, K @endverbatim
  *
  * All execution stops until a key is pressed, then the value of that key is
- * stored in Vx.
+ * stored in Vx. While no key is pressed, the program counter stays on this
+ * instruction and waiting_for_key is set.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx0a(Chip8* chip);
+void op_fx0a(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx15
@@ -367,8 +406,9 @@ void op_fx0a(Chip8* chip);
  * DT is set equal to the value of Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx15(Chip8* chip);
+void op_fx15(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx18
@@ -379,8 +419,9 @@ void op_fx15(Chip8* chip);
  * ST is set equal to the value of Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx18(Chip8* chip);
+void op_fx18(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx1E
@@ -391,8 +432,9 @@ void op_fx18(Chip8* chip);
  * The values of I and Vx are added, and the results are stored in I.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx1e(Chip8* chip);
+void op_fx1e(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx29
@@ -405,8 +447,9 @@ void op_fx1e(Chip8* chip);
  * information on the Chip-8 hexadecimal font.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx29(Chip8* chip);
+void op_fx29(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx33
@@ -419,8 +462,9 @@ void op_fx29(Chip8* chip);
  * digit at location I+2.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx33(Chip8* chip);
+void op_fx33(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx55
@@ -432,8 +476,9 @@ void op_fx33(Chip8* chip);
  * starting at the address in I.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx55(Chip8* chip);
+void op_fx55(Chip8* chip, const Chip8Instruction* instruction);
 
 /**
  * @name Fx65
@@ -445,7 +490,8 @@ void op_fx55(Chip8* chip);
  * registers V0 through Vx.
  *
  * @param chip State of the chip8 CPU.
+ * @param instruction Operands of the opcode, extracted by decode().
  */
-void op_fx65(Chip8* chip);
+void op_fx65(Chip8* chip, const Chip8Instruction* instruction);
 
 #endif /* INSTRUCTIONS_H */
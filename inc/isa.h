@@ -0,0 +1,50 @@
+#ifndef ISA_H
+#define ISA_H
+
+/**
+ * @brief The chip8 instruction set, described once.
+ *
+ * Every entry is X(OP, handler, mask, pattern, syntax): an opcode is the
+ * instruction CHIP8_OP_##OP when (opcode & mask) == pattern, it executes
+ * through handler and it is written as syntax, the notation used in
+ * instructions.h, where Vx, Vy, addr, byte and nibble stand for the operands.
+ * No two entries match the same opcode. The Chip8Op enum, the dispatch
+ * tables, identify() and disassemble() are all generated from this list.
+ */
+#define CHIP8_ISA(X) \
+	X(00E0, op_00e0, 0xffff, 0x00e0, "CLS") \
+	X(00EE, op_00ee, 0xffff, 0x00ee, "RET") \
+	X(1NNN, op_1nnn, 0xf000, 0x1000, "JP addr") \
+	X(2NNN, op_2nnn, 0xf000, 0x2000, "CALL addr") \
+	X(3XKK, op_3xkk, 0xf000, 0x3000, "SE Vx, byte") \
+	X(4XKK, op_4xkk, 0xf000, 0x4000, "SNE Vx, byte") \
+	X(5XY0, op_5xy0, 0xf00f, 0x5000, "SE Vx, Vy") \
+	X(6XKK, op_6xkk, 0xf000, 0x6000, "LD Vx, byte") \
+	X(7XKK, op_7xkk, 0xf000, 0x7000, "ADD Vx, byte") \
+	X(8XY0, op_8xy0, 0xf00f, 0x8000, "LD Vx, Vy") \
+	X(8XY1, op_8xy1, 0xf00f, 0x8001, "OR Vx, Vy") \
+	X(8XY2, op_8xy2, 0xf00f, 0x8002, "AND Vx, Vy") \
+	X(8XY3, op_8xy3, 0xf00f, 0x8003, "XOR Vx, Vy") \
+	X(8XY4, op_8xy4, 0xf00f, 0x8004, "ADD Vx, Vy") \
+	X(8XY5, op_8xy5, 0xf00f, 0x8005, "SUB Vx, Vy") \
+	X(8XY6, op_8xy6, 0xf00f, 0x8006, "SHR Vx, Vy") \
+	X(8XY7, op_8xy7, 0xf00f, 0x8007, "SUBN Vx, Vy") \
+	X(8XYE, op_8xye, 0xf00f, 0x800e, "SHL Vx, Vy") \
+	X(9XY0, op_9xy0, 0xf00f, 0x9000, "SNE Vx, Vy") \
+	X(ANNN, op_annn, 0xf000, 0xa000, "LD I, addr") \
+	X(BNNN, op_bnnn, 0xf000, 0xb000, "JP V0, addr") \
+	X(CXKK, cxkk, 0xf000, 0xc000, "RND Vx, byte") \
+	X(DXYN, op_dxyn, 0xf000, 0xd000, "DRW Vx, Vy, nibble") \
+	X(EX9E, op_ex9e, 0xf0ff, 0xe09e, "SKP Vx") \
+	X(EXA1, op_exa1, 0xf0ff, 0xe0a1, "SKNP Vx") \
+	X(FX07, op_fx07, 0xf0ff, 0xf007, "LD Vx, DT") \
+	X(FX0A, op_fx0a, 0xf0ff, 0xf00a, "LD Vx, K") \
+	X(FX15, op_fx15, 0xf0ff, 0xf015, "LD DT, Vx") \
+	X(FX18, op_fx18, 0xf0ff, 0xf018, "LD ST, Vx") \
+	X(FX1E, op_fx1e, 0xf0ff, 0xf01e, "ADD I, Vx") \
+	X(FX29, op_fx29, 0xf0ff, 0xf029, "LD F, Vx") \
+	X(FX33, op_fx33, 0xf0ff, 0xf033, "LD B, Vx") \
+	X(FX55, op_fx55, 0xf0ff, 0xf055, "LD [I], Vx") \
+	X(FX65, op_fx65, 0xf0ff, 0xf065, "LD Vx, [I]")
+
+#endif /* ISA_H */
@@ -0,0 +1,31 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "chip8.h"
+
+/**
+ * @brief Execute count instructions with the x86-64 recompiler.
+ *
+ * Straight-line runs of guest code are translated into native code the first
+ * time they are reached and cached by their entry address. A block ends at a
+ * jump, call, return, skip, draw, key wait or memory store, and never crosses
+ * a CHIP8_PAGE_SIZE page, so a write to a page only has to discard the blocks
+ * that start in it. The results are the same as calling cycle() count times.
+ *
+ * The code buffer is only ever writable or executable, never both. Hosts that
+ * are not x86-64, or that refuse to make memory executable, fall back to
+ * run_threaded().
+ *
+ * @param chip State of the chip8 CPU.
+ * @param count Number of instructions to execute.
+ */
+void run_jit(Chip8* chip, uint32_t count);
+
+/**
+ * @brief Release the translated code of a chip.
+ *
+ * @param jit Recompiler state, may be NULL.
+ */
+void jit_destroy(struct Chip8Jit* jit);
+
+#endif /* JIT_H */
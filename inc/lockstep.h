@@ -0,0 +1,100 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "chip8.h"
+
+// Lanes are stepped in groups of this many, one byte per lane in a vector
+// register: AVX2 when the compiler targets it, SSE2 or NEON otherwise.
+#ifdef __AVX2__
+#define CHIP8_LOCKSTEP_VECTOR_SIZE 32
+#else
+#define CHIP8_LOCKSTEP_VECTOR_SIZE 16
+#endif
+
+/**
+ * Many chips kept as a structure of arrays, so that the same field of every
+ * lane is contiguous. Per-lane scalars are indexed [lane] and registers and
+ * keys [register * stride + lane]. Memory, stack and video stay whole per
+ * lane, [lane * size + offset], since they are addressed through per-lane
+ * pointers anyway.
+ */
+typedef struct Chip8Lockstep {
+	uint32_t lane_count;
+	// lane_count rounded up to a whole vector. The padding lanes are never
+	// executed.
+	uint32_t stride;
+	uint8_t* registers;
+	uint8_t* keypad;
+	uint8_t* waiting_for_key;
+	uint8_t* memory;
+	uint16_t* stack;
+	uint64_t* video;
+	uint16_t* index;
+	uint16_t* pc;
+	uint16_t* opcode;
+	uint8_t* sp;
+	uint8_t* delay_timer;
+	uint8_t* sound_timer;
+	uint32_t* dirty_rows;
+	uint64_t* instruction_count;
+	uint64_t* timers_updated_at;
+	uint16_t* instructions_per_tick;
+	uint64_t* random_state;
+	// Bit n is set when page n of the memory of a lane is the same as the one
+	// of the first lane of its group, which is then fetched for both.
+	uint16_t* shared_pages;
+} Chip8Lockstep;
+
+/**
+ * @brief Allocate lane_count blank lanes.
+ *
+ * @param lane_count Number of chips to step together.
+ * @return The lanes, or NULL if they could not be allocated.
+ */
+Chip8Lockstep* create_lockstep(uint32_t lane_count);
+
+/**
+ * @brief Copy the machine state of a chip into a lane.
+ *
+ * @param lockstep Lanes.
+ * @param lane Lane to overwrite.
+ * @param chip Chip to copy from.
+ */
+void lockstep_load(Chip8Lockstep* lockstep, uint32_t lane, Chip8* chip);
+
+/**
+ * @brief Copy the machine state of a lane back into a chip.
+ *
+ * @param lockstep Lanes.
+ * @param lane Lane to copy from.
+ * @param chip Chip to overwrite. Its decoded instructions are discarded.
+ */
+void lockstep_store(Chip8Lockstep* lockstep, uint32_t lane, Chip8* chip);
+
+/**
+ * @brief Execute count instructions on every lane.
+ *
+ * Each step fetches one instruction per lane, or a single one for a group of
+ * CHIP8_LOCKSTEP_VECTOR_SIZE lanes running the same code at the same address.
+ * Within a group, the lanes that share the opcode of the first lane execute it
+ * together when it is a register, index or jump instruction, with the lanes
+ * that diverge masked out. Those, and every other
+ * instruction, execute one lane at a time. Each lane ends in the same state as
+ * a chip that called cycle() count times, except that addresses outside memory,
+ * the stack and the keypad wrap around instead of reaching past them.
+ *
+ * Compilers without vector extensions execute every lane one at a time.
+ *
+ * @param lockstep Lanes.
+ * @param count Number of instructions to execute on each lane.
+ */
+void run_lockstep(Chip8Lockstep* lockstep, uint32_t count);
+
+/**
+ * @brief Release the lanes.
+ *
+ * @param lockstep Lanes, may be NULL.
+ */
+void lockstep_destroy(Chip8Lockstep* lockstep);
+
+#endif /* LOCKSTEP_H */
@@ -0,0 +1,104 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+#define CHIP8_MOVIE_VERSION 1
+
+/**
+ * The keypad as it was from an instruction on. Bit k of keys is set while key
+ * k is pressed.
+ */
+typedef struct Chip8MovieEvent {
+	uint64_t instruction;
+	uint32_t frame;
+	uint16_t keys;
+} Chip8MovieEvent;
+
+/**
+ * Everything a run depends on besides the ROM: the seed of the RNG, the rate
+ * of the timers and every change of the keypad, stamped with the instruction
+ * count it happened at. Replaying the events at those counts gives the same
+ * run on every engine, however the instructions are split between calls to
+ * run().
+ *
+ * On disk, a movie is the magic "C8MV", a version byte, instructions per tick
+ * (16 bits), the seed (64 bits) and the event count (32 bits), all little
+ * endian, followed by the events. Each event is the instructions and the
+ * frames since the previous one as LEB128 varints and the keys as 16 bits,
+ * so a key press usually takes 5 bytes.
+ */
+typedef struct Chip8Movie {
+	uint64_t seed;
+	uint16_t instructions_per_tick;
+	Chip8MovieEvent* events;
+	size_t event_count;
+	size_t event_capacity;
+} Chip8Movie;
+
+/**
+ * @brief Allocate an empty movie.
+ *
+ * @param seed Seed of the RNG of the recorded chip.
+ * @param instructions_per_tick Instructions per tick of the recorded chip.
+ * @return The movie, or NULL if it could not be allocated.
+ */
+Chip8Movie* create_movie(uint64_t seed, uint16_t instructions_per_tick);
+
+/**
+ * @brief Append an event. Events must come in increasing instruction order.
+ *
+ * @param movie Movie to append to.
+ * @param event Keypad from event->instruction on.
+ * @return 0 on success, -1 if the event is out of order or could not be
+ * allocated.
+ */
+int movie_add(Chip8Movie* movie, Chip8MovieEvent event);
+
+/**
+ * @brief Append an event if the keypad of a chip changed since the last one.
+ * All keys are released before the first event.
+ *
+ * @param movie Movie to append to.
+ * @param chip Chip to read the keypad and instruction count from.
+ * @param frame Frame the keypad was read on.
+ * @return 0 on success, -1 if the event could not be allocated.
+ */
+int movie_record(Chip8Movie* movie, Chip8* chip, uint32_t frame);
+
+/**
+ * @brief Write the keys of an event to the keypad of a chip.
+ *
+ * @param event Event to replay.
+ * @param chip Chip to press the keys on.
+ */
+void movie_apply(const Chip8MovieEvent* event, Chip8* chip);
+
+/**
+ * @brief Write a movie to a file.
+ *
+ * @param movie Movie to write.
+ * @param path File to create or overwrite.
+ * @return 0 on success, -1 if the file could not be written.
+ */
+int save_movie(const Chip8Movie* movie, const char* path);
+
+/**
+ * @brief Read a movie written by save_movie().
+ *
+ * @param path File to read.
+ * @return The movie, or NULL if the file could not be read, is not a movie
+ * of this version, or runs no instructions per tick.
+ */
+Chip8Movie* load_movie(const char* path);
+
+/**
+ * @brief Free a movie.
+ *
+ * @param movie Movie to free.
+ */
+void movie_destroy(Chip8Movie* movie);
+
+#endif /* MOVIE_H */
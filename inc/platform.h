@@ -3,14 +3,28 @@
 
 #include <stdint.h>
 #include <SDL.h>
+#include "frames.h"
 
-extern SDL_Window* platform_window;
-extern SDL_Renderer* platform_renderer;
-extern SDL_Texture* platform_texture;
+// A window and the thread drawing the frames published for it.
+typedef struct Platform {
+	SDL_Window* window;
+	SDL_Renderer* renderer;
+	SDL_Texture* texture;
+	Chip8Frames* frames;
+	SDL_Thread* render_thread;
+	SDL_sem* frame_ready;
+	// Posted by the render thread once it has its renderer, or failed to.
+	SDL_sem* render_started;
+	int render_failed;
+	atomic_int quit;
+	// Set while the rewind key is held.
+	int rewinding;
+} Platform;
 
-void platform_create(char* title, int window_width, int window_height, int texture_width, int texture_height);
-void platform_destroy(void);
-void platform_update(uint32_t* video, int pitch);
-int platform_process_input(uint8_t* keypad);
+Platform* platform_create(char* title, int window_width, int window_height, Chip8Frames* frames);
+void platform_destroy(Platform* platform);
+void platform_update(Platform* platform);
+int platform_process_input(Platform* platform, uint8_t* keypad);
+int platform_wait_input(Platform* platform, uint8_t* keypad);
 
 #endif /* PLATFORM_H */
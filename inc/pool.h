@@ -0,0 +1,65 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+// Back the pool with explicit hugepages when the system has them reserved, or
+// ask for transparent ones otherwise.
+#define CHIP8_POOL_HUGEPAGES 0x1
+
+/**
+ * A fixed number of chips in one contiguous arena, each starting on its own
+ * cache line. Taking a chip out of the pool resets it from a pristine chip
+ * instead of allocating it, and a chip put back keeps its decoded
+ * instructions and JIT buffer for the next run. A pool is not thread-safe:
+ * give each thread a pool of its own.
+ */
+typedef struct Chip8Pool {
+	uint8_t* arena;
+	size_t arena_size;
+	size_t stride;
+	uint32_t capacity;
+	uint32_t* free_slots;
+	uint32_t free_count;
+} Chip8Pool;
+
+/**
+ * @brief Map the arena of a pool.
+ *
+ * @param capacity Number of chips in the pool.
+ * @param flags CHIP8_POOL_HUGEPAGES or 0.
+ * @return The pool, or NULL if it could not be allocated.
+ */
+Chip8Pool* create_pool(uint32_t capacity, int flags);
+
+/**
+ * @brief Take a chip out of the pool, reset to a pristine one.
+ *
+ * The pristine chip is typically made once with create() and load_rom(), and
+ * then shared by every run of that ROM, on any thread since it is only read.
+ * Its seed, instructions per tick and engine are copied as well.
+ *
+ * @param pool Pool to take from.
+ * @param pristine Chip to copy the machine from.
+ * @return The chip, or NULL if every chip of the pool is taken.
+ */
+Chip8* pool_acquire(Chip8Pool* pool, const Chip8* pristine);
+
+/**
+ * @brief Put a chip back into the pool it was taken from.
+ *
+ * @param pool Pool the chip belongs to.
+ * @param chip Chip to put back. It must not be passed to destroy().
+ */
+void pool_release(Chip8Pool* pool, Chip8* chip);
+
+/**
+ * @brief Unmap the arena and free what the chips in it own.
+ *
+ * @param pool Pool to free.
+ */
+void pool_destroy(Chip8Pool* pool);
+
+#endif /* POOL_H */
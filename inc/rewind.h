@@ -0,0 +1,71 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+#include "state.h"
+
+// Largest encoding of one frame: a run header of at most 4 bytes for every 3
+// bytes of the machine, in the worst case.
+#define CHIP8_REWIND_MAX_DELTA_SIZE (CHIP8_MACHINE_SIZE + 4 * (CHIP8_MACHINE_SIZE / 3 + 1))
+
+/**
+ * The last frames of a chip, newest first, in a fixed memory budget. Only the
+ * newest machine is kept whole. Every older frame is the XOR of itself and
+ * the frame after it, stored as runs of unchanged bytes to skip and changed
+ * bytes to XOR back in, so a frame where only the registers, timers and a few
+ * rows of video changed takes a few dozen bytes. Once the budget is used up,
+ * the oldest frames are dropped to make room.
+ *
+ * The deltas live back to back in a ring, each with its size before and after
+ * it, so the newest one can be taken off the end and the oldest one off the
+ * start.
+ */
+typedef struct Chip8Rewind {
+	uint8_t* buffer;
+	size_t capacity;
+	size_t start;
+	size_t end;
+	size_t used;
+	uint32_t frame_count;
+	int has_newest;
+	Chip8State newest;
+	// Scratch for the frame being encoded or decoded.
+	uint8_t delta[CHIP8_REWIND_MAX_DELTA_SIZE];
+} Chip8Rewind;
+
+/**
+ * @brief Allocate an empty history.
+ *
+ * @param budget Bytes to keep the deltas in.
+ * @return The history, or NULL if it could not be allocated.
+ */
+Chip8Rewind* create_rewind(size_t budget);
+
+/**
+ * @brief Record the machine of a chip as the newest frame.
+ *
+ * @param history History to record into.
+ * @param chip Chip to record, usually once per frame.
+ */
+void rewind_push(Chip8Rewind* history, const Chip8* chip);
+
+/**
+ * @brief Drop the newest frame and put a chip back in the one before it.
+ *
+ * @param history History to take the frame from.
+ * @param chip Chip to overwrite.
+ * @return 0 on success, -1 if there is no older frame left. The chip is left
+ * as it was then.
+ */
+int rewind_pop(Chip8Rewind* history, Chip8* chip);
+
+/**
+ * @brief Free a history.
+ *
+ * @param history History to free.
+ */
+void rewind_destroy(Chip8Rewind* history);
+
+#endif /* REWIND_H */
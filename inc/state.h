@@ -0,0 +1,109 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+#define CHIP8_STATE_VERSION 1
+// Where the machine starts in a state file, so that it can be mapped on its
+// own.
+#define CHIP8_STATE_ALIGNMENT 4096
+#define CHIP8_STATE_BYTE_ORDER 0x01020304u
+
+/**
+ * A snapshot of everything a chip executes from: registers, memory, stack,
+ * timers, keypad, video, counters and the RNG. The decoded instructions are
+ * left out, since they are rebuilt from memory.
+ */
+typedef struct Chip8State {
+	uint8_t machine[CHIP8_MACHINE_SIZE];
+} Chip8State;
+
+/**
+ * Start of a state file. The machine follows at offset CHIP8_STATE_ALIGNMENT,
+ * laid out exactly as in struct Chip8 and padded with zeros to a multiple of
+ * CHIP8_STATE_ALIGNMENT, so a file can be mapped straight over a chip. That
+ * layout belongs to the build that wrote it: a file is only loaded by builds
+ * with the same version, byte order and machine size.
+ */
+typedef struct Chip8StateHeader {
+	char magic[4];
+	uint32_t version;
+	// CHIP8_STATE_BYTE_ORDER as the writer stored it.
+	uint32_t byte_order;
+	uint32_t machine_offset;
+	uint32_t machine_size;
+} Chip8StateHeader;
+
+/**
+ * @brief Copy the machine of a chip into a snapshot.
+ *
+ * @param chip Chip to save.
+ * @param state Snapshot to overwrite.
+ */
+void chip8_save_state(const Chip8* chip, Chip8State* state);
+
+/**
+ * @brief Put a chip back in the state of a snapshot.
+ *
+ * Only the decoded instructions of the pages of memory that differ from the
+ * snapshot are dropped. The engine, JIT buffer and recompiled ROM of the chip
+ * are kept.
+ *
+ * @param chip Chip to overwrite.
+ * @param state Snapshot to restore.
+ */
+void chip8_load_state(Chip8* chip, const Chip8State* state);
+
+/**
+ * @brief Write the machine of a chip to a state file.
+ *
+ * @param chip Chip to save.
+ * @param path File to create or overwrite.
+ * @return CHIP8_OK, or the error that stopped the file from being written.
+ */
+Chip8Error chip8_save_state_file(const Chip8* chip, char* path);
+
+/**
+ * @brief Put a chip back in the state saved in a file.
+ *
+ * @param chip Chip to overwrite. It is left as it was on error.
+ * @param path File written by chip8_save_state_file().
+ * @return CHIP8_OK, CHIP8_ERROR_OPEN_FILE, or CHIP8_ERROR_READ_FILE if the
+ * file is not a state written by this build.
+ */
+Chip8Error chip8_load_state_file(Chip8* chip, char* path);
+
+/**
+ * @brief Start a chip straight from a state file, without reading it.
+ *
+ * The machine is mapped copy-on-write from the file, so nothing is copied up
+ * front, and the pages a chip never writes to stay shared with every other
+ * process started from the same file. Decoded instructions are rebuilt as the
+ * chip runs. Falls back to reading the machine when the system pages are
+ * larger than CHIP8_STATE_ALIGNMENT. Every row of video is marked dirty, so
+ * the first frame published shows the whole screen.
+ *
+ * @param chip Set to the new chip, or to NULL on error.
+ * @param path File written by chip8_save_state_file().
+ * @return CHIP8_OK, CHIP8_ERROR_OPEN_FILE, CHIP8_ERROR_READ_FILE if the file
+ * is not a state written by this build, or CHIP8_ERROR_OUT_OF_MEMORY.
+ */
+Chip8Error chip8_map_state_file(Chip8** chip, char* path);
+
+/**
+ * @brief Free a chip made by chip8_map_state_file().
+ *
+ * @param chip Chip to free. It must not be passed to destroy().
+ */
+void chip8_unmap_state_file(Chip8* chip);
+
+/**
+ * @brief Check that a header describes a state file this build can load.
+ *
+ * @param header Header read or mapped from the start of a file.
+ * @return 1 if the machine that follows it can be loaded, 0 otherwise.
+ */
+int is_state_header_valid(const Chip8StateHeader* header);
+
+#endif /* STATE_H */
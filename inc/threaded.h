@@ -0,0 +1,20 @@
+#ifndef THREADED_H
+#define THREADED_H
+
+#include "chip8.h"
+
+/**
+ * @brief Execute count instructions with the threaded interpreter.
+ *
+ * Every instruction body jumps straight to the body of the next one through
+ * its own indirect branch, instead of returning to a shared dispatch loop.
+ * The results are the same as calling cycle() count times.
+ *
+ * Compilers without labels as values fall back to cycle().
+ *
+ * @param chip State of the chip8 CPU.
+ * @param count Number of instructions to execute.
+ */
+void run_threaded(Chip8* chip, uint32_t count);
+
+#endif /* THREADED_H */
@@ -0,0 +1,101 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+#include "../inc/aot.h"
+
+typedef struct Chip8Aot {
+	void* library;
+	const Chip8AotProgram* program;
+	const Chip8AotBlock* blocks[CHIP8_MEMORY_SIZE];
+	uint32_t version[CHIP8_MEMORY_SIZE];
+	uint8_t checked[CHIP8_MEMORY_SIZE];
+	uint8_t valid[CHIP8_MEMORY_SIZE];
+} Chip8Aot;
+
+int load_aot(Chip8* chip, char* library_name) {
+	Chip8Aot* aot = calloc(1, sizeof(Chip8Aot));
+
+	if (!aot) {
+		return -1;
+	}
+
+	aot->library = dlopen(library_name, RTLD_NOW | RTLD_LOCAL);
+	aot->program = aot->library ? dlsym(aot->library, "chip8_aot_program") : NULL;
+
+	if (!aot->program) {
+		aot_destroy(aot);
+		return -1;
+	}
+
+	for (uint16_t i = 0; i < aot->program->block_count; i++) {
+		const Chip8AotBlock* block = &aot->program->blocks[i];
+
+		if (block->address < CHIP8_MEMORY_SIZE) {
+			aot->blocks[block->address] = block;
+		}
+	}
+
+	aot_destroy(chip->aot);
+	chip->aot = aot;
+
+	return 0;
+}
+
+void aot_destroy(Chip8Aot* aot) {
+	if (!aot) {
+		return;
+	}
+
+	if (aot->library) {
+		dlclose(aot->library);
+	}
+
+	free(aot);
+}
+
+static uint8_t rom_byte(const Chip8AotProgram* program, uint32_t address) {
+	uint32_t offset = address - CHIP8_ROM_START_ADDRESS;
+
+	return address >= CHIP8_ROM_START_ADDRESS && offset < program->rom_size ? program->rom[offset] : 0;
+}
+
+static int matches_rom(Chip8* chip, const Chip8AotProgram* program, const Chip8AotBlock* block) {
+	for (uint32_t address = block->address; address < block->address + 2u * block->length; address++) {
+		if (chip->memory[address] != rom_byte(program, address)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void run_aot(Chip8* chip, uint32_t count) {
+	Chip8Aot* aot = chip->aot;
+
+	while (count) {
+		uint16_t pc = chip->pc;
+		const Chip8AotBlock* block = aot && pc < CHIP8_MEMORY_SIZE ? aot->blocks[pc] : NULL;
+
+		if (block) {
+			uint32_t version = chip->page_version[pc / CHIP8_PAGE_SIZE];
+
+			if (!aot->checked[pc] || aot->version[pc] != version) {
+				aot->valid[pc] = matches_rom(chip, aot->program, block);
+				aot->version[pc] = version;
+				aot->checked[pc] = 1;
+			}
+
+			if (!aot->valid[pc]) {
+				block = NULL;
+			}
+		}
+
+		if (!block || block->length > count) {
+			cycle(chip);
+			count--;
+			continue;
+		}
+
+		block->code(chip);
+		count -= block->length;
+	}
+}
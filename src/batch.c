@@ -0,0 +1,478 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../inc/chip8.h"
+#include "../inc/movie.h"
+#include "../inc/pool.h"
+
+#define DEFAULT_INSTRUCTIONS 1000000
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+// How often a run stopping at a jump to itself checks whether it got there.
+#define HALT_CHECK_INSTRUCTIONS 65536
+
+typedef struct BatchRun {
+	char* rom;
+	uint64_t framebuffer_hash;
+	uint64_t instructions;
+	double seconds;
+	int halted;
+	// Why the ROM could not be run, or CHIP8_OK.
+	Chip8Error error;
+} BatchRun;
+
+// Each worker owns a deque of run indices. The owner pops from the tail and
+// idle workers steal from the head, so a few long runs do not leave the
+// other cores waiting on a static partition.
+typedef struct BatchQueue {
+	pthread_mutex_t lock;
+	size_t* runs;
+	size_t head;
+	size_t tail;
+} BatchQueue;
+
+typedef struct Batch {
+	BatchRun* runs;
+	size_t run_count;
+	BatchQueue* queues;
+	size_t worker_count;
+	uint64_t instructions;
+	uint64_t seed;
+	uint16_t instructions_per_tick;
+	uint8_t engine;
+	int stop_when_halted;
+	// Input of every run, from an input script or a recorded movie.
+	Chip8Movie* movie;
+	// Every run starts from this chip, which is only read.
+	Chip8* blank;
+} Batch;
+
+// Each worker reuses a single pooled chip for all of its runs, so a run
+// neither allocates a chip nor maps a new JIT buffer.
+typedef struct BatchWorker {
+	Batch* batch;
+	size_t id;
+	Chip8Pool* pool;
+	pthread_t thread;
+	int started;
+} BatchWorker;
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint64_t hash_framebuffer(Chip8* chip) {
+	uint64_t hash = FNV_OFFSET_BASIS;
+	const uint8_t* bytes = (const uint8_t*)chip->video;
+
+	for (size_t i = 0; i < sizeof(chip->video); i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static void execute_run(BatchWorker* worker, BatchRun* batch_run) {
+	Batch* batch = worker->batch;
+	Chip8* chip = pool_acquire(worker->pool, batch->blank);
+	Chip8Error error = load_rom(chip, batch_run->rom);
+	if (error) {
+		fprintf(stderr, "Cannot run %s: %s\n", batch_run->rom, chip8_strerror(error));
+		batch_run->error = error;
+		pool_release(worker->pool, chip);
+		return;
+	}
+	seed_random(chip, batch->seed);
+	chip->instructions_per_tick = batch->instructions_per_tick;
+	chip->engine = batch->engine;
+
+	const Chip8Movie* movie = batch->movie;
+	double start = now();
+	size_t event = 0;
+	while (chip->instruction_count < batch->instructions) {
+		while (event < movie->event_count && movie->events[event].instruction <= chip->instruction_count) {
+			movie_apply(&movie->events[event++], chip);
+		}
+
+		uint64_t until = batch->instructions;
+		if (event < movie->event_count && movie->events[event].instruction < until) {
+			until = movie->events[event].instruction;
+		}
+		if (batch->stop_when_halted && until - chip->instruction_count > HALT_CHECK_INSTRUCTIONS) {
+			until = chip->instruction_count + HALT_CHECK_INSTRUCTIONS;
+		}
+		run(chip, until - chip->instruction_count);
+
+		// Waiting for a key after the last scripted event is a halt as well.
+		if (batch->stop_when_halted && (is_halted(chip) || (chip->waiting_for_key && event == movie->event_count))) {
+			batch_run->halted = 1;
+			break;
+		}
+	}
+	batch_run->seconds = now() - start;
+
+	batch_run->framebuffer_hash = hash_framebuffer(chip);
+	batch_run->instructions = chip->instruction_count;
+
+	pool_release(worker->pool, chip);
+}
+
+static int pop_run(BatchQueue* queue, size_t* run) {
+	int found = 0;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		*run = queue->runs[--queue->tail];
+		found = 1;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return found;
+}
+
+static int steal_run(BatchQueue* queue, size_t* run) {
+	int found = 0;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		*run = queue->runs[queue->head++];
+		found = 1;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return found;
+}
+
+static void* work(void* argument) {
+	BatchWorker* worker = argument;
+	Batch* batch = worker->batch;
+	size_t run;
+
+	for (;;) {
+		if (pop_run(&batch->queues[worker->id], &run)) {
+			execute_run(worker, &batch->runs[run]);
+			continue;
+		}
+
+		// No run is queued after startup, so all deques empty means done.
+		int stolen = 0;
+		for (size_t i = 1; i < batch->worker_count && !stolen; i++) {
+			stolen = steal_run(&batch->queues[(worker->id + i) % batch->worker_count], &run);
+		}
+		if (!stolen) {
+			return NULL;
+		}
+		execute_run(worker, &batch->runs[run]);
+	}
+}
+
+static int compare_runs(const void* a, const void* b) {
+	return strcmp(((const BatchRun*)a)->rom, ((const BatchRun*)b)->rom);
+}
+
+static Chip8Error collect_roms(Batch* batch, char* directory) {
+	DIR* dir = opendir(directory);
+	if (!dir) {
+		return CHIP8_ERROR_OPEN_FILE;
+	}
+
+	size_t capacity = 0;
+	struct dirent* entry;
+	while ((entry = readdir(dir))) {
+		size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+		char* path = malloc(length);
+		if (!path) {
+			closedir(dir);
+			return CHIP8_ERROR_OUT_OF_MEMORY;
+		}
+		snprintf(path, length, "%s/%s", directory, entry->d_name);
+
+		struct stat info;
+		if (stat(path, &info) || !S_ISREG(info.st_mode)) {
+			free(path);
+			continue;
+		}
+
+		if (batch->run_count == capacity) {
+			size_t grown = capacity ? capacity * 2 : 64;
+			BatchRun* runs = realloc(batch->runs, grown * sizeof(BatchRun));
+			if (!runs) {
+				free(path);
+				closedir(dir);
+				return CHIP8_ERROR_OUT_OF_MEMORY;
+			}
+			batch->runs = runs;
+			capacity = grown;
+		}
+		batch->runs[batch->run_count++] = (BatchRun){ .rom = path };
+	}
+	closedir(dir);
+
+	qsort(batch->runs, batch->run_count, sizeof(BatchRun), compare_runs);
+
+	return CHIP8_OK;
+}
+
+// One event per line: <instruction> <key in hex> <1 for pressed, 0 for released>,
+// in increasing instruction order. Scripts have no frames, so every event is
+// on frame 0.
+static Chip8Movie* load_input_script(char* script) {
+	FILE* f = fopen(script, "r");
+	if (!f) {
+		return NULL;
+	}
+
+	Chip8Movie* movie = create_movie(0, CHIP8_INSTRUCTIONS_PER_TICK);
+	uint16_t keys = 0;
+	unsigned long long instruction;
+	unsigned key, pressed;
+	while (movie && fscanf(f, "%llu %x %u", &instruction, &key, &pressed) == 3) {
+		if (key >= CHIP8_KEYPAD_SIZE) {
+			break;
+		}
+		keys = pressed ? keys | 1u << key : keys & ~(1u << key);
+		if (movie_add(movie, (Chip8MovieEvent){ instruction, 0, keys })) {
+			break;
+		}
+	}
+	if (movie && !feof(f)) {
+		movie_destroy(movie);
+		movie = NULL;
+	}
+	fclose(f);
+
+	return movie;
+}
+
+// Parse a whole decimal number from minimum to maximum, or return -1.
+static int parse_number(const char* text, long minimum, long maximum, long* value) {
+	char* end;
+	errno = 0;
+	*value = strtol(text, &end, 10);
+
+	return errno || end == text || *end || *value < minimum || *value > maximum ? -1 : 0;
+}
+
+// Print a string as a JSON string literal, quotes included.
+static void print_json_string(const char* text) {
+	putchar('"');
+	for (const unsigned char* c = (const unsigned char*) text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			printf("\\%c", *c);
+		} else if (*c < 0x20) {
+			printf("\\u%04x", *c);
+		} else {
+			putchar(*c);
+		}
+	}
+	putchar('"');
+}
+
+static void usage(char* name) {
+	fprintf(stderr, "Usage: %s [-n instructions] [-s seed] [-i input script | -m movie] [-e table|flat|threaded|jit] [-j threads] [-t] <rom directory>\n", name);
+}
+
+int main(int argc, char** argv) {
+	static Batch batch;
+	batch.instructions = DEFAULT_INSTRUCTIONS;
+	batch.instructions_per_tick = CHIP8_INSTRUCTIONS_PER_TICK;
+	batch.engine = CHIP8_ENGINE_JIT;
+	batch.worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	long number;
+	int option;
+	while ((option = getopt(argc, argv, "n:s:i:m:e:j:t")) != -1) {
+		switch (option) {
+			case 'n':
+				if (parse_number(optarg, 1, LONG_MAX, &number)) {
+					fprintf(stderr, "The instructions must be from 1 to %ld\n", LONG_MAX);
+					usage(argv[0]);
+					return 1;
+				}
+				batch.instructions = number;
+				break;
+			case 's':
+				batch.seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'i':
+				movie_destroy(batch.movie);
+				batch.movie = load_input_script(optarg);
+				if (!batch.movie) {
+					fprintf(stderr, "Invalid input script %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'm':
+				// A movie replays with the seed and timer rate it was
+				// recorded with.
+				movie_destroy(batch.movie);
+				batch.movie = load_movie(optarg);
+				if (!batch.movie) {
+					fprintf(stderr, "Invalid movie %s\n", optarg);
+					return 1;
+				}
+				batch.seed = batch.movie->seed;
+				batch.instructions_per_tick = batch.movie->instructions_per_tick;
+				break;
+			case 'e':
+				if (!strcmp(optarg, "table")) {
+					batch.engine = CHIP8_ENGINE_TABLE;
+				} else if (!strcmp(optarg, "flat")) {
+					batch.engine = CHIP8_ENGINE_FLAT;
+				} else if (!strcmp(optarg, "threaded")) {
+					batch.engine = CHIP8_ENGINE_THREADED;
+				} else if (!strcmp(optarg, "jit")) {
+					batch.engine = CHIP8_ENGINE_JIT;
+				} else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'j':
+				if (parse_number(optarg, 1, LONG_MAX, &number)) {
+					fprintf(stderr, "The threads must be from 1 to %ld\n", LONG_MAX);
+					usage(argv[0]);
+					return 1;
+				}
+				batch.worker_count = number;
+				break;
+			case 't':
+				batch.stop_when_halted = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1 || !batch.worker_count) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!batch.movie) {
+		batch.movie = create_movie(batch.seed, batch.instructions_per_tick);
+	}
+
+	batch.blank = create();
+	if (!batch.movie || !batch.blank) {
+		fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+		return 1;
+	}
+
+	Chip8Error error = collect_roms(&batch, argv[optind]);
+	if (error) {
+		fprintf(stderr, "Cannot read directory %s: %s\n", argv[optind], chip8_strerror(error));
+		return 1;
+	}
+
+	if (batch.worker_count > batch.run_count) {
+		batch.worker_count = batch.run_count ? batch.run_count : 1;
+	}
+
+	batch.queues = calloc(batch.worker_count, sizeof(BatchQueue));
+	if (!batch.queues) {
+		fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+		return 1;
+	}
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		pthread_mutex_init(&batch.queues[i].lock, NULL);
+		batch.queues[i].runs = malloc((batch.run_count / batch.worker_count + 1) * sizeof(size_t));
+		if (!batch.queues[i].runs) {
+			fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < batch.run_count; i++) {
+		BatchQueue* queue = &batch.queues[i % batch.worker_count];
+		queue->runs[queue->tail++] = i;
+	}
+
+	BatchWorker* workers = calloc(batch.worker_count, sizeof(BatchWorker));
+	if (!workers) {
+		fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+		return 1;
+	}
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		workers[i] = (BatchWorker){ .batch = &batch, .id = i, .pool = create_pool(1, 0) };
+		if (!workers[i].pool) {
+			fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+			return 1;
+		}
+	}
+
+	double start = now();
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		workers[i].started = !pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+	}
+	// The main thread takes the place of any worker that could not start,
+	// so its deque is not left to the others to steal.
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		if (!workers[i].started) {
+			fprintf(stderr, "Cannot start thread %zu, running its ROMs on the main thread\n", i);
+			work(&workers[i]);
+		}
+	}
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+	double elapsed = now() - start;
+
+	// A ROM that could not be run is reported with its error instead of
+	// results, and fails the whole batch.
+	uint64_t total_instructions = 0;
+	int failed = 0;
+	printf("{\n");
+	printf("  \"runs\": [\n");
+	for (size_t i = 0; i < batch.run_count; i++) {
+		BatchRun* batch_run = &batch.runs[i];
+		printf("    { \"rom\": ");
+		print_json_string(batch_run->rom);
+		if (batch_run->error) {
+			printf(", \"error\": \"%s\" }%s\n", chip8_strerror(batch_run->error), i + 1 < batch.run_count ? "," : "");
+			failed = 1;
+			continue;
+		}
+		total_instructions += batch_run->instructions;
+		printf(", \"framebuffer_hash\": \"%016llx\", \"instructions\": %llu, "
+				"\"halted\": %s, \"seconds\": %.6f, \"instructions_per_second\": %.0f }%s\n",
+				(unsigned long long)batch_run->framebuffer_hash,
+				(unsigned long long)batch_run->instructions, batch_run->halted ? "true" : "false", batch_run->seconds,
+				batch_run->seconds > 0 ? batch_run->instructions / batch_run->seconds : 0,
+				i + 1 < batch.run_count ? "," : "");
+	}
+	printf("  ],\n");
+	printf("  \"threads\": %zu,\n", batch.worker_count);
+	printf("  \"seconds\": %.6f,\n", elapsed);
+	printf("  \"instructions_per_second\": %.0f\n", elapsed > 0 ? total_instructions / elapsed : 0);
+	printf("}\n");
+
+	for (size_t i = 0; i < batch.worker_count; i++) {
+		pthread_mutex_destroy(&batch.queues[i].lock);
+		free(batch.queues[i].runs);
+		pool_destroy(workers[i].pool);
+	}
+	for (size_t i = 0; i < batch.run_count; i++) {
+		free(batch.runs[i].rom);
+	}
+	free(batch.queues);
+	free(batch.runs);
+	free(workers);
+	movie_destroy(batch.movie);
+	destroy(batch.blank);
+
+	return failed;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../inc/instructions.h"
+#include "../inc/lockstep.h"
+#include "../inc/rewind.h"
+
+#define DEFAULT_OP_ITERATIONS 2000000
+#define DEFAULT_ROM_INSTRUCTIONS 20000000
+#define LOCKSTEP_LANES 1024
+#define REWIND_FRAMES 3600
+#define REWIND_BUDGET (1024 * 1024)
+#define BRANCHES 100000
+#define BRANCH_INSTRUCTIONS 100
+
+typedef struct OpBenchmark {
+	const char* name;
+	Chip8Handler handler;
+	uint16_t opcode;
+	uint8_t x;
+	uint8_t y;
+	uint16_t index;
+} OpBenchmark;
+
+typedef struct RomBenchmark {
+	const char* name;
+	const uint8_t* rom;
+	size_t size;
+} RomBenchmark;
+
+typedef struct EngineBenchmark {
+	const char* name;
+	Chip8Engine engine;
+} EngineBenchmark;
+
+static void cxkk(Chip8* chip, const Chip8Instruction* instruction) {
+	op_cxkk(chip, instruction, generate_random_byte);
+}
+
+static const OpBenchmark op_benchmarks[] = {
+	{ "00e0", op_00e0, 0x00e0, 0, 0, 0x300 },
+	{ "1nnn", op_1nnn, 0x1200, 0, 0, 0x300 },
+	{ "3xkk", op_3xkk, 0x3101, 0, 0, 0x300 },
+	{ "4xkk", op_4xkk, 0x4101, 0, 0, 0x300 },
+	{ "5xy0", op_5xy0, 0x5120, 0, 0, 0x300 },
+	{ "6xkk", op_6xkk, 0x61aa, 0, 0, 0x300 },
+	{ "7xkk", op_7xkk, 0x7103, 0, 0, 0x300 },
+	{ "8xy0", op_8xy0, 0x8120, 0, 0, 0x300 },
+	{ "8xy1", op_8xy1, 0x8121, 0, 0, 0x300 },
+	{ "8xy2", op_8xy2, 0x8122, 0, 0, 0x300 },
+	{ "8xy3", op_8xy3, 0x8123, 0, 0, 0x300 },
+	{ "8xy4", op_8xy4, 0x8124, 0, 0, 0x300 },
+	{ "8xy5", op_8xy5, 0x8125, 0, 0, 0x300 },
+	{ "8xy6", op_8xy6, 0x8126, 0, 0, 0x300 },
+	{ "8xy7", op_8xy7, 0x8127, 0, 0, 0x300 },
+	{ "8xye", op_8xye, 0x812e, 0, 0, 0x300 },
+	{ "9xy0", op_9xy0, 0x9120, 0, 0, 0x300 },
+	{ "annn", op_annn, 0xa300, 0, 0, 0x300 },
+	{ "bnnn", op_bnnn, 0xb200, 0, 0, 0x300 },
+	{ "cxkk", cxkk, 0xc1ff, 0, 0, 0x300 },
+	{ "dxyn_h1_aligned", op_dxyn, 0xd121, 8, 4, 0x050 },
+	{ "dxyn_h5_aligned", op_dxyn, 0xd125, 8, 4, 0x050 },
+	{ "dxyn_h15_aligned", op_dxyn, 0xd12f, 8, 4, 0x050 },
+	{ "dxyn_h5_unaligned", op_dxyn, 0xd125, 13, 7, 0x050 },
+	{ "dxyn_h15_unaligned", op_dxyn, 0xd12f, 13, 7, 0x050 },
+	{ "dxyn_h15_wrapping", op_dxyn, 0xd12f, 60, 25, 0x050 },
+	{ "ex9e", op_ex9e, 0xe19e, 0, 0, 0x300 },
+	{ "exa1", op_exa1, 0xe1a1, 0, 0, 0x300 },
+	{ "fx07", op_fx07, 0xf107, 0, 0, 0x300 },
+	{ "fx0a", op_fx0a, 0xf10a, 0, 0, 0x300 },
+	{ "fx15", op_fx15, 0xf115, 0, 0, 0x300 },
+	{ "fx18", op_fx18, 0xf118, 0, 0, 0x300 },
+	{ "fx1e", op_fx1e, 0xf11e, 0, 0, 0x300 },
+	{ "fx29", op_fx29, 0xf129, 0, 0, 0x300 },
+	{ "fx33", op_fx33, 0xf133, 0, 0, 0x300 },
+	{ "fx55", op_fx55, 0xff55, 0, 0, 0x300 },
+	{ "fx65", op_fx65, 0xff65, 0, 0, 0x300 },
+};
+
+// Arithmetic in a counted loop.
+static const uint8_t alu_rom[] = {
+	0x60, 0x00, // 0x200: LD V0, 0x00
+	0x61, 0x01, // 0x202: LD V1, 0x01
+	0x70, 0x01, // 0x204: ADD V0, 0x01
+	0x82, 0x14, // 0x206: ADD V2, V1
+	0x83, 0x03, // 0x208: XOR V3, V0
+	0x84, 0x26, // 0x20a: SHR V4
+	0x85, 0x35, // 0x20c: SUB V5, V3
+	0x30, 0x00, // 0x20e: SE V0, 0x00
+	0x12, 0x04, // 0x210: JP 0x204
+	0x12, 0x00, // 0x212: JP 0x200
+};
+
+// Font sprites drawn across the screen, clearing it every 64 sprites.
+static const uint8_t draw_rom[] = {
+	0x00, 0xe0, // 0x200: CLS
+	0x60, 0x00, // 0x202: LD V0, 0x00
+	0x61, 0x00, // 0x204: LD V1, 0x00
+	0x62, 0x00, // 0x206: LD V2, 0x00
+	0xf2, 0x29, // 0x208: LD F, V2
+	0xd0, 0x15, // 0x20a: DRW V0, V1, 5
+	0x70, 0x05, // 0x20c: ADD V0, 0x05
+	0x71, 0x03, // 0x20e: ADD V1, 0x03
+	0x72, 0x01, // 0x210: ADD V2, 0x01
+	0x32, 0x40, // 0x212: SE V2, 0x40
+	0x12, 0x08, // 0x214: JP 0x208
+	0x12, 0x00, // 0x216: JP 0x200
+};
+
+// Calls, BCD, memory loads and stores and a delay timer wait.
+static const uint8_t mixed_rom[] = {
+	0x65, 0x14, // 0x200: LD V5, 0x14
+	0xa3, 0x80, // 0x202: LD I, 0x380
+	0x22, 0x12, // 0x204: CALL 0x212
+	0xf0, 0x33, // 0x206: LD B, V0
+	0xf2, 0x65, // 0x208: LD V2, [I]
+	0xf1, 0x07, // 0x20a: LD V1, DT
+	0x41, 0x00, // 0x20c: SNE V1, 0x00
+	0xf5, 0x15, // 0x20e: LD DT, V5
+	0x12, 0x02, // 0x210: JP 0x202
+	0x70, 0x01, // 0x212: ADD V0, 0x01
+	0xf0, 0x55, // 0x214: LD [I], V0
+	0x00, 0xee, // 0x216: RET
+};
+
+// Register setup pairs, sprite draws after LD I, a counted loop and a delay
+// timer wait.
+static const uint8_t idioms_rom[] = {
+	0x60, 0x00, // 0x200: LD V0, 0x00
+	0x61, 0x00, // 0x202: LD V1, 0x00
+	0xa0, 0x50, // 0x204: LD I, 0x050
+	0xd0, 0x15, // 0x206: DRW V0, V1, 5
+	0x70, 0x01, // 0x208: ADD V0, 0x01
+	0x30, 0x20, // 0x20a: SE V0, 0x20
+	0x12, 0x04, // 0x20c: JP 0x204
+	0x62, 0x02, // 0x20e: LD V2, 0x02
+	0xf2, 0x15, // 0x210: LD DT, V2
+	0xf3, 0x07, // 0x212: LD V3, DT
+	0x33, 0x00, // 0x214: SE V3, 0x00
+	0x12, 0x12, // 0x216: JP 0x212
+	0x12, 0x00, // 0x218: JP 0x200
+};
+
+static const RomBenchmark rom_benchmarks[] = {
+	{ "alu", alu_rom, sizeof(alu_rom) },
+	{ "draw", draw_rom, sizeof(draw_rom) },
+	{ "mixed", mixed_rom, sizeof(mixed_rom) },
+	{ "idioms", idioms_rom, sizeof(idioms_rom) },
+};
+
+static const EngineBenchmark engine_benchmarks[] = {
+	{ "table", CHIP8_ENGINE_TABLE },
+	{ "flat", CHIP8_ENGINE_FLAT },
+	{ "threaded", CHIP8_ENGINE_THREADED },
+	{ "jit", CHIP8_ENGINE_JIT },
+};
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// A benchmark cannot go on without its chips, so running out of memory ends
+// the whole run.
+static void* check_allocation(void* allocation) {
+	if (!allocation) {
+		fprintf(stderr, "%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+		exit(1);
+	}
+
+	return allocation;
+}
+
+static Chip8* prepare_op(const OpBenchmark* benchmark) {
+	Chip8* chip = check_allocation(create());
+
+	for (uint8_t i = 0; i < CHIP8_REGISTER_COUNT; i++) {
+		chip->registers[i] = i;
+	}
+
+	chip->registers[0x1] = benchmark->x;
+	chip->registers[0x2] = benchmark->y;
+	chip->index = benchmark->index;
+	chip->keypad[0x1] = 0xff;
+	chip->opcode = benchmark->opcode;
+
+	return chip;
+}
+
+static double benchmark_op(const OpBenchmark* benchmark, uint32_t iterations) {
+	Chip8* chip = prepare_op(benchmark);
+	Chip8Instruction instruction;
+	decode_operands(benchmark->opcode, &instruction);
+
+	double start = now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		benchmark->handler(chip, &instruction);
+	}
+	double elapsed = now() - start;
+
+	destroy(chip);
+
+	return elapsed * 1e9 / iterations;
+}
+
+// 2nnn and 00ee only make sense in pairs, or the stack over or underflows.
+static double benchmark_call_return(uint32_t iterations) {
+	Chip8* chip = prepare_op(&op_benchmarks[0]);
+	Chip8Instruction call, ret;
+	decode_operands(0x2300, &call);
+	decode_operands(0x00ee, &ret);
+
+	double start = now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		chip->opcode = 0x2300;
+		op_2nnn(chip, &call);
+		op_00ee(chip, &ret);
+	}
+	double elapsed = now() - start;
+
+	destroy(chip);
+
+	return elapsed * 1e9 / iterations;
+}
+
+// Record a minute of the mixed ROM, one frame at a time, timing the pushes only.
+static double benchmark_rewind_push(const RomBenchmark* rom, size_t* used) {
+	Chip8* chip = check_allocation(create());
+	memcpy(&chip->memory[CHIP8_ROM_START_ADDRESS], rom->rom, rom->size);
+	seed_random(chip, 0);
+	Chip8Rewind* history = check_allocation(create_rewind(REWIND_BUDGET));
+
+	double elapsed = 0;
+	for (uint32_t i = 0; i < REWIND_FRAMES; i++) {
+		run(chip, chip->instructions_per_tick);
+		double start = now();
+		rewind_push(history, chip);
+		elapsed += now() - start;
+	}
+	*used = history->used;
+
+	rewind_destroy(history);
+	destroy(chip);
+
+	return elapsed * 1e9 / REWIND_FRAMES;
+}
+
+// Branch from the same parent over and over, running the child a little in
+// between, timing only the branching: either a clone or a whole reset.
+static double benchmark_branch(const RomBenchmark* rom, int clone) {
+	Chip8* parent = check_allocation(create());
+	memcpy(&parent->memory[CHIP8_ROM_START_ADDRESS], rom->rom, rom->size);
+	invalidate_decoded(parent, CHIP8_ROM_START_ADDRESS, rom->size);
+	seed_random(parent, 0);
+	run(parent, 10000);
+	Chip8* child = check_allocation(create());
+
+	double elapsed = 0;
+	for (uint32_t i = 0; i < BRANCHES; i++) {
+		double start = now();
+		if (clone) {
+			chip8_clone(child, parent);
+		} else {
+			chip8_reset(child, parent);
+		}
+		elapsed += now() - start;
+		run(child, BRANCH_INSTRUCTIONS);
+	}
+
+	destroy(child);
+	destroy(parent);
+
+	return elapsed * 1e9 / BRANCHES;
+}
+
+static void benchmark_rom(const RomBenchmark* rom, const EngineBenchmark* engine, uint32_t instructions, int last) {
+	Chip8* chip = check_allocation(create());
+	memcpy(&chip->memory[CHIP8_ROM_START_ADDRESS], rom->rom, rom->size);
+	seed_random(chip, 0);
+	chip->engine = engine->engine;
+
+	// Warm up decode caches and translated code before measuring.
+	run(chip, 10000);
+
+	double start = now();
+	run(chip, instructions);
+	double elapsed = now() - start;
+
+	printf("    { \"rom\": \"%s\", \"engine\": \"%s\", \"instructions\": %u, \"seconds\": %.6f, "
+			"\"instructions_per_second\": %.0f, \"ns_per_instruction\": %.3f, \"frames_per_second\": %.0f }%s\n",
+			rom->name, engine->name, instructions, elapsed,
+			instructions / elapsed, elapsed * 1e9 / instructions,
+			instructions / elapsed / chip->instructions_per_tick, last ? "" : ",");
+
+	destroy(chip);
+}
+
+// The same instruction budget, spread over LOCKSTEP_LANES copies of the ROM.
+static void benchmark_lockstep(const RomBenchmark* rom, uint32_t instructions, int last) {
+	Chip8* chip = check_allocation(create());
+	memcpy(&chip->memory[CHIP8_ROM_START_ADDRESS], rom->rom, rom->size);
+	Chip8Lockstep* lockstep = check_allocation(create_lockstep(LOCKSTEP_LANES));
+
+	for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		seed_random(chip, lane);
+		lockstep_load(lockstep, lane, chip);
+	}
+
+	uint32_t steps = instructions / LOCKSTEP_LANES;
+	instructions = steps * LOCKSTEP_LANES;
+
+	double start = now();
+	run_lockstep(lockstep, steps);
+	double elapsed = now() - start;
+
+	printf("    { \"rom\": \"%s\", \"engine\": \"lockstep\", \"lanes\": %u, \"instructions\": %u, \"seconds\": %.6f, "
+			"\"instructions_per_second\": %.0f, \"ns_per_instruction\": %.3f, \"frames_per_second\": %.0f }%s\n",
+			rom->name, LOCKSTEP_LANES, instructions, elapsed,
+			instructions / elapsed, elapsed * 1e9 / instructions,
+			instructions / elapsed / chip->instructions_per_tick, last ? "" : ",");
+
+	lockstep_destroy(lockstep);
+	destroy(chip);
+}
+
+int main(int argc, char** argv) {
+	uint32_t op_iterations = DEFAULT_OP_ITERATIONS;
+	uint32_t rom_instructions = DEFAULT_ROM_INSTRUCTIONS;
+
+	if (argc > 1) {
+		rom_instructions = strtoul(argv[1], NULL, 10);
+		op_iterations = rom_instructions / 10;
+	}
+
+	if (!op_iterations || !rom_instructions) {
+		printf("Usage: %s [instructions per rom]\n", argv[0]);
+		return 1;
+	}
+
+	size_t op_count = sizeof(op_benchmarks) / sizeof(op_benchmarks[0]);
+	size_t rom_count = sizeof(rom_benchmarks) / sizeof(rom_benchmarks[0]);
+	size_t engine_count = sizeof(engine_benchmarks) / sizeof(engine_benchmarks[0]);
+
+	printf("{\n");
+	printf("  \"ops\": [\n");
+	printf("    { \"op\": \"2nnn_00ee\", \"iterations\": %u, \"ns_per_op\": %.3f },\n",
+			op_iterations, benchmark_call_return(op_iterations));
+	for (size_t i = 0; i < op_count; i++) {
+		printf("    { \"op\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.3f }%s\n",
+				op_benchmarks[i].name, op_iterations, benchmark_op(&op_benchmarks[i], op_iterations),
+				i + 1 < op_count ? "," : "");
+	}
+	printf("  ],\n");
+
+	// The mixed ROM both computes and draws, like most games.
+	size_t rewind_used;
+	double rewind_ns = benchmark_rewind_push(&rom_benchmarks[2], &rewind_used);
+	printf("  \"rewind\": { \"rom\": \"%s\", \"frames\": %u, \"bytes\": %zu, \"ns_per_push\": %.3f },\n",
+			rom_benchmarks[2].name, REWIND_FRAMES, rewind_used, rewind_ns);
+
+	printf("  \"branch\": { \"rom\": \"%s\", \"branches\": %u, \"ns_per_clone\": %.3f, \"ns_per_reset\": %.3f },\n",
+			rom_benchmarks[2].name, BRANCHES, benchmark_branch(&rom_benchmarks[2], 1),
+			benchmark_branch(&rom_benchmarks[2], 0));
+
+	printf("  \"roms\": [\n");
+	for (size_t i = 0; i < rom_count; i++) {
+		for (size_t j = 0; j < engine_count; j++) {
+			benchmark_rom(&rom_benchmarks[i], &engine_benchmarks[j], rom_instructions, 0);
+		}
+		benchmark_lockstep(&rom_benchmarks[i], rom_instructions, i + 1 == rom_count);
+	}
+	printf("  ]\n");
+	printf("}\n");
+
+	return 0;
+}
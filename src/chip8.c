@@ -1,14 +1,22 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/random.h>
 #include "../inc/chip8.h"
 #include "../inc/instructions.h"
+#include "../inc/threaded.h"
+#include "../inc/jit.h"
+#include "../inc/aot.h"
 
-static uint16_t start_address = 0x0200;
-static uint16_t end_address = 0x0fff;
+// Every table in this file is either const or, for flat_handlers, written
+// once before main() and only read afterwards, so any number of chips can run
+// on any number of threads at once.
+static const uint16_t end_address = 0x0fff;
 
-static uint8_t font_set_size = 80;
-static uint8_t font_set[80] = {
+static const uint8_t font_set_size = 80;
+static const uint8_t font_set[80] = {
 	0xf0, 0x90, 0x90, 0x90, 0xf0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
 	0xf0, 0x10, 0xf0, 0x80, 0xf0, // 2
@@ -27,150 +35,688 @@ static uint8_t font_set[80] = {
 	0xf0, 0x80, 0xf0, 0x80, 0x80  // F
 };
 
-static void (*opcode_table[0x10])(Chip8*) = {0};
-static void (*table_zero[0xf])(Chip8*) = {0};
-static void (*table_eight[0xf])(Chip8*) = {0};
-static void (*table_e[0xf])(Chip8*) = {0};
-static void (*table_f[0x66])(Chip8*) = {0};
+static void cxkk(Chip8* chip, const Chip8Instruction* instruction) {
+	op_cxkk(chip, instruction, generate_random_byte);
+}
+
+#define HANDLER(OP, handler, mask, pattern, syntax) [CHIP8_OP_##OP] = &handler,
+#define SYNTAX(OP, handler, mask, pattern, syntax) [CHIP8_OP_##OP] = syntax,
+#define IDENTIFY(OP, handler, mask, pattern, syntax) \
+	if ((opcode & mask) == pattern) { \
+		return CHIP8_OP_##OP; \
+	}
+
+static const Chip8Handler handlers[CHIP8_OP_COUNT] = {
+	[CHIP8_OP_NULL] = &op_invalid,
+	CHIP8_ISA(HANDLER)
+};
+
+// The handler of every 16-bit opcode, for the flat engine. It is filled before
+// main() runs and only read afterwards.
+static Chip8Handler flat_handlers[0x10000];
+
+__attribute__((constructor))
+static void fill_flat_handlers(void) {
+	for (uint32_t opcode = 0; opcode < 0x10000; opcode++) {
+		flat_handlers[opcode] = handlers[identify(opcode)];
+	}
+}
+
+static const char* syntaxes[CHIP8_OP_COUNT] = {
+	CHIP8_ISA(SYNTAX)
+};
+
+Chip8Op identify(uint16_t opcode) {
+	CHIP8_ISA(IDENTIFY)
+
+	return CHIP8_OP_NULL;
+}
+
+/*
+ * Write the syntax of the instruction with its operands filled in. Opcodes
+ * outside the instruction set are written as a data word.
+ */
+void disassemble(uint16_t opcode, char* text, size_t size) {
+	const char* syntax = syntaxes[identify(opcode)];
+	size_t length = 0;
+
+	if (!syntax) {
+		snprintf(text, size, "DW 0x%04x", opcode);
+		return;
+	}
+
+	while (*syntax && length < size) {
+		int written;
+
+		if (!strncmp(syntax, "Vx", 2)) {
+			written = snprintf(text + length, size - length, "V%X", (opcode & 0x0f00u) >> 8u);
+			syntax += 2;
+		} else if (!strncmp(syntax, "Vy", 2)) {
+			written = snprintf(text + length, size - length, "V%X", (opcode & 0x00f0u) >> 4u);
+			syntax += 2;
+		} else if (!strncmp(syntax, "addr", 4)) {
+			written = snprintf(text + length, size - length, "0x%03x", opcode & 0x0fffu);
+			syntax += 4;
+		} else if (!strncmp(syntax, "byte", 4)) {
+			written = snprintf(text + length, size - length, "0x%02x", opcode & 0x00ffu);
+			syntax += 4;
+		} else if (!strncmp(syntax, "nibble", 6)) {
+			written = snprintf(text + length, size - length, "%u", opcode & 0x000fu);
+			syntax += 6;
+		} else {
+			written = snprintf(text + length, size - length, "%c", *syntax);
+			syntax++;
+		}
+
+		length += written;
+	}
+}
+
+/*
+ * The fused handlers run with pc still on the first instruction of the
+ * sequence and leave the chip as stepping through each op_* handler would.
+ */
+static uint32_t fused_6xkk_6xkk(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	uint16_t second = instruction->next_opcodes[0];
 
-static void zero(Chip8* chip) {
-	table_zero[chip->opcode & 0x000fu](chip);
+	chip->registers[instruction->x] = instruction->kk;
+	chip->registers[(second & 0x0f00u) >> 8u] = second & 0x00ffu;
+	chip->opcode = second;
+	chip->pc += 4;
+	chip->instruction_count += 2;
+
+	return 2;
 }
 
-static void eight(Chip8* chip) {
-	table_eight[chip->opcode & 0x000fu](chip);
+static uint32_t fused_annn_dxyn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	chip->index = instruction->nnn;
+	chip->opcode = instruction->next_opcodes[0];
+	chip->pc += 4;
+	Chip8Instruction draw;
+	decode_operands(instruction->next_opcodes[0], &draw);
+	op_dxyn(chip, &draw);
+	chip->instruction_count += 2;
+
+	return 2;
 }
 
-static void e(Chip8* chip) {
-	table_e[chip->opcode & 0x000fu](chip);
+// Run the 3xkk; 1nnn tail of a loop once its first instruction executed.
+static uint8_t skip_or_jump(Chip8* chip, const Chip8Instruction* instruction) {
+	uint16_t second = instruction->next_opcodes[0];
+	uint16_t third = instruction->next_opcodes[1];
+
+	if (chip->registers[(second & 0x0f00u) >> 8u] == (second & 0x00ffu)) {
+		chip->opcode = second;
+		chip->pc += 4;
+		chip->instruction_count += 2;
+
+		return 2;
+	}
+
+	chip->opcode = third;
+	chip->pc = third & 0x0fffu;
+	chip->instruction_count += 3;
+
+	return 3;
 }
 
-static void f(Chip8* chip) {
-	table_f[chip->opcode & 0x00ffu](chip);
+static uint32_t fused_fx07_3xkk_1nnn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	update_timers(chip);
+	chip->registers[instruction->x] = chip->delay_timer;
+	chip->pc += 2;
+
+	return skip_or_jump(chip, instruction);
 }
 
-static void cxkk(Chip8* chip) {
-	op_cxkk(chip, generate_random_byte);
+static uint32_t fused_7xkk_3xkk_1nnn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	chip->registers[instruction->x] += instruction->kk;
+	chip->pc += 2;
+
+	return skip_or_jump(chip, instruction);
 }
 
-static void op_null(Chip8* chip) {}
+/*
+ * The idle loops below keep coming back to the same instructions until a
+ * timer tick or a key changes something. They skip every iteration that is
+ * known to loop again. Keys only change between calls to run().
+ */
+static uint32_t idle_1nnn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	chip->opcode = instruction->opcode;
+	chip->instruction_count += count;
 
-static void initialize(void) {
-	opcode_table[0x0] = &zero;
-	opcode_table[0x1] = &op_1nnn;
-	opcode_table[0x2] = &op_2nnn;
-	opcode_table[0x3] = &op_3xkk;
-	opcode_table[0x4] = &op_4xkk;
-	opcode_table[0x5] = &op_5xy0;
-	opcode_table[0x6] = &op_6xkk;
-	opcode_table[0x7] = &op_7xkk;
-	opcode_table[0x8] = &eight;
-	opcode_table[0x9] = &op_9xy0;
-	opcode_table[0xa] = &op_annn;
-	opcode_table[0xb] = &op_bnnn;
-	opcode_table[0xc] = &cxkk;
-	opcode_table[0xd] = &op_dxyn;
-	opcode_table[0xe] = &e;
-	opcode_table[0xf] = &f;
+	return count;
+}
 
-	for (uint8_t i = 0; i < 0xf; i++) {
-		table_zero[i] = &op_null;
-		table_eight[i] = &op_null;
-		table_e[i] = &op_null;
+static uint32_t idle_fx0a(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	chip->opcode = instruction->opcode;
+	chip->pc += 2;
+	instruction->handler(chip, instruction);
+
+	if (!chip->waiting_for_key) {
+		chip->instruction_count++;
+		return 1;
 	}
 
-	table_zero[0x0] = &op_00e0;
-	table_zero[0xe] = &op_00ee;
+	chip->instruction_count += count;
+
+	return count;
+}
+
+static uint32_t idle_fx07_3xkk_1nnn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	uint8_t kk = instruction->next_opcodes[0] & 0x00ffu;
+	uint64_t iterations = count / 3;
 
-	table_eight[0x0] = &op_8xy0;
-	table_eight[0x1] = &op_8xy1;
-	table_eight[0x2] = &op_8xy2;
-	table_eight[0x3] = &op_8xy3;
-	table_eight[0x4] = &op_8xy4;
-	table_eight[0x5] = &op_8xy5;
-	table_eight[0x6] = &op_8xy6;
-	table_eight[0x7] = &op_8xy7;
-	table_eight[0xe] = &op_8xye;
+	update_timers(chip);
 
-	table_e[0x1] = &op_exa1;
-	table_e[0xe] = &op_ex9e;
+	// Every iteration before the tick that brings the delay timer down to kk
+	// reads a different value and loops again. When kk is above it, the wait
+	// never ends.
+	if (kk <= chip->delay_timer) {
+		uint64_t until_exit = (uint64_t) (chip->delay_timer - kk) * chip->instructions_per_tick;
+		uint64_t elapsed = chip->instruction_count - chip->timers_updated_at;
+		uint64_t looping = until_exit > elapsed ? (until_exit - elapsed + 2) / 3 : 0;
 
-	for (uint8_t i = 0; i < 0x66; i++) {
-		table_f[i] = &op_null;
+		if (looping < iterations) {
+			iterations = looping;
+		}
 	}
 
-	table_f[0x07] = &op_fx07;
-	table_f[0x0a] = &op_fx0a;
-	table_f[0x15] = &op_fx15;
-	table_f[0x18] = &op_fx18;
-	table_f[0x1e] = &op_fx1e;
-	table_f[0x29] = &op_fx29;
-	table_f[0x33] = &op_fx33;
-	table_f[0x55] = &op_fx55;
-	table_f[0x65] = &op_fx65;
+	if (!iterations) {
+		return fused_fx07_3xkk_1nnn(chip, instruction, count);
+	}
+
+	chip->instruction_count += 3 * (iterations - 1);
+	update_timers(chip);
+	chip->registers[instruction->x] = chip->delay_timer;
+	chip->opcode = instruction->next_opcodes[1];
+	chip->instruction_count += 3;
+
+	return 3 * iterations;
+}
+
+static uint32_t idle_key_1nnn(Chip8* chip, const Chip8Instruction* instruction, uint32_t count) {
+	uint16_t address = chip->pc;
+
+	chip->opcode = instruction->opcode;
+	chip->pc += 2;
+	instruction->handler(chip, instruction);
+
+	if (chip->pc != address + 2) {
+		chip->instruction_count++;
+		return 1;
+	}
+
+	chip->opcode = instruction->next_opcodes[0];
+	chip->pc = address;
+	chip->instruction_count += count & ~1u;
+
+	return count & ~1u;
+}
+
+typedef struct Chip8Fusion {
+	uint8_t length;
+	uint8_t ops[CHIP8_FUSED_MAX_LENGTH];
+	Chip8FusedHandler handler;
+} Chip8Fusion;
+
+static const Chip8Fusion fusions[] = {
+	{ 2, { CHIP8_OP_6XKK, CHIP8_OP_6XKK }, &fused_6xkk_6xkk },
+	{ 2, { CHIP8_OP_ANNN, CHIP8_OP_DXYN }, &fused_annn_dxyn },
+	{ 3, { CHIP8_OP_FX07, CHIP8_OP_3XKK, CHIP8_OP_1NNN }, &fused_fx07_3xkk_1nnn },
+	{ 3, { CHIP8_OP_7XKK, CHIP8_OP_3XKK, CHIP8_OP_1NNN }, &fused_7xkk_3xkk_1nnn },
+};
+
+static uint16_t fetch_opcode(Chip8* chip, uint16_t address) {
+	return (chip->memory[address] << 8u) | chip->memory[(address + 1) & CHIP8_ADDRESS_MASK];
+}
+
+static void fuse(Chip8* chip, uint16_t address, Chip8Instruction* instruction) {
+	uint8_t ops[CHIP8_FUSED_MAX_LENGTH] = { instruction->op };
+
+	instruction->fused = NULL;
+
+	if (instruction->op == CHIP8_OP_1NNN && instruction->nnn == address) {
+		instruction->fused = &idle_1nnn;
+		return;
+	}
+
+	if (instruction->op == CHIP8_OP_FX0A) {
+		instruction->fused = &idle_fx0a;
+		return;
+	}
+
+	if (address + 2 * CHIP8_FUSED_MAX_LENGTH > CHIP8_MEMORY_SIZE) {
+		return;
+	}
+
+	for (uint8_t i = 1; i < CHIP8_FUSED_MAX_LENGTH; i++) {
+		instruction->next_opcodes[i - 1] = fetch_opcode(chip, address + 2 * i);
+		ops[i] = identify(instruction->next_opcodes[i - 1]);
+	}
+
+	if ((ops[0] == CHIP8_OP_EX9E || ops[0] == CHIP8_OP_EXA1) && instruction->next_opcodes[0] == (0x1000u | address)) {
+		instruction->fused = &idle_key_1nnn;
+		return;
+	}
+
+	if (ops[0] == CHIP8_OP_FX07 && ops[1] == CHIP8_OP_3XKK && ops[2] == CHIP8_OP_1NNN
+			&& ((instruction->next_opcodes[0] & 0x0f00u) >> 8u) == instruction->x
+			&& instruction->next_opcodes[1] == (0x1000u | address)) {
+		instruction->fused = &idle_fx07_3xkk_1nnn;
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(fusions) / sizeof(fusions[0]); i++) {
+		if (!memcmp(ops, fusions[i].ops, fusions[i].length)) {
+			instruction->fused = fusions[i].handler;
+			return;
+		}
+	}
+}
+
+void decode_operands(uint16_t opcode, Chip8Instruction* instruction) {
+	instruction->opcode = opcode;
+	instruction->nnn = opcode & 0x0fffu;
+	instruction->x = (opcode & 0x0f00u) >> 8u;
+	instruction->y = (opcode & 0x00f0u) >> 4u;
+	instruction->kk = opcode & 0x00ffu;
+	instruction->n = opcode & 0x000fu;
+}
+
+void decode(Chip8* chip, uint16_t address, Chip8Instruction* instruction) {
+	uint16_t opcode = fetch_opcode(chip, address);
+
+	decode_operands(opcode, instruction);
+	instruction->op = identify(opcode);
+	instruction->handler = handlers[instruction->op];
+
+	fuse(chip, address, instruction);
+}
+
+/*
+ * pc itself never wraps, only the fetch does, as on the lockstep engine. The
+ * cache has no entry for a pc past the end of memory, so the instruction is
+ * decoded again every time, and not fused since fused handlers take pc for
+ * their own address.
+ */
+void decode_past_memory(Chip8* chip, Chip8Instruction* instruction) {
+	decode(chip, chip->pc & CHIP8_ADDRESS_MASK, instruction);
+	instruction->fused = NULL;
+}
+
+static atomic_uint_fast64_t last_id;
+
+static uint64_t next_id(void) {
+	return atomic_fetch_add(&last_id, 1) + 1;
 }
 
 Chip8* create(void) {
 	Chip8* a = calloc(1, sizeof(Chip8));
 
 	if (!a) {
-		exit(2);
+		return NULL;
 	}
 
 	memcpy(&a->memory[CHIP8_FONT_SET_START_ADDRESS], font_set, font_set_size);
 
-	a->pc = start_address;
+	a->id = next_id();
+	a->pc = CHIP8_ROM_START_ADDRESS;
+	a->dirty_rows = 0xffffffff;
+	a->instructions_per_tick = CHIP8_INSTRUCTIONS_PER_TICK;
+
+	uint64_t seed;
+	if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+		seed = (uint64_t) time(NULL) ^ (uintptr_t) a;
+	}
+	seed_random(a, seed);
 
 	return a;
 }
 
-void load_rom(Chip8* chip, char* rom_name) {
+Chip8Error load_rom(Chip8* chip, char* rom_name) {
 	FILE* f = fopen(rom_name, "r");
 	if (!f) {
-		exit(1);
+		return CHIP8_ERROR_OPEN_FILE;
 	}
-	fread(&chip->memory[start_address], end_address - start_address, 1, f);
+	chip->rom_size = fread(&chip->memory[CHIP8_ROM_START_ADDRESS], 1, end_address - CHIP8_ROM_START_ADDRESS, f);
+	int failed = ferror(f);
 	fclose(f);
+
+	invalidate_decoded(chip, 0, CHIP8_MEMORY_SIZE);
+
+	return failed ? CHIP8_ERROR_READ_FILE : CHIP8_OK;
 }
 
-void dump_memory_to_file(Chip8* chip, char* memory_file_name) {
+Chip8Error dump_memory_to_file(Chip8* chip, char* memory_file_name) {
 	FILE* f = fopen(memory_file_name, "wb");
 	if (!f) {
-		exit(1);
+		return CHIP8_ERROR_OPEN_FILE;
 	}
-	fwrite(chip->memory, sizeof(uint8_t), CHIP8_MEMORY_SIZE, f);
-	fclose(f);
+	size_t written = fwrite(chip->memory, sizeof(uint8_t), CHIP8_MEMORY_SIZE, f);
+
+	return fclose(f) || written != CHIP8_MEMORY_SIZE ? CHIP8_ERROR_WRITE_FILE : CHIP8_OK;
+}
+
+const char* chip8_strerror(Chip8Error error) {
+	switch (error) {
+		case CHIP8_OK:
+			return "no error";
+		case CHIP8_ERROR_OUT_OF_MEMORY:
+			return "out of memory";
+		case CHIP8_ERROR_OPEN_FILE:
+			return "cannot open file";
+		case CHIP8_ERROR_READ_FILE:
+			return "cannot read file";
+		case CHIP8_ERROR_WRITE_FILE:
+			return "cannot write file";
+	}
+
+	return "unknown error";
 }
 
 void cycle(Chip8* chip) {
-	if (!opcode_table[0]) {
-		initialize();
+	Chip8Instruction past_memory;
+	Chip8Instruction* instruction;
+
+	if (chip->pc >= CHIP8_MEMORY_SIZE) {
+		instruction = &past_memory;
+		decode_past_memory(chip, instruction);
+	} else {
+		instruction = &chip->decoded[chip->pc];
+		if (!instruction->handler) {
+			decode(chip, chip->pc, instruction);
+		}
 	}
 
-	chip->opcode = (chip->memory[chip->pc] << 8u) | chip->memory[chip->pc + 1];
+	chip->opcode = instruction->opcode;
 
 	chip->pc += 2;
 
-	opcode_table[(chip->opcode & 0xf000u) >> 12u](chip);
+	instruction->handler(chip, instruction);
+
+	chip->instruction_count++;
+}
+
+/*
+ * Step like cycle(), but run a whole fused sequence with one dispatch while
+ * count leaves room for the longest one.
+ */
+static void run_table(Chip8* chip, uint32_t count) {
+	Chip8Instruction past_memory;
+
+	while (count >= CHIP8_FUSED_MAX_LENGTH) {
+		Chip8Instruction* instruction;
+
+		if (chip->pc >= CHIP8_MEMORY_SIZE) {
+			instruction = &past_memory;
+			decode_past_memory(chip, instruction);
+		} else {
+			instruction = &chip->decoded[chip->pc];
+			if (!instruction->handler) {
+				decode(chip, chip->pc, instruction);
+			}
+		}
+
+		if (instruction->fused) {
+			count -= instruction->fused(chip, instruction, count);
+			continue;
+		}
+
+		chip->opcode = instruction->opcode;
+		chip->pc += 2;
+
+		instruction->handler(chip, instruction);
+
+		chip->instruction_count++;
+		count--;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		cycle(chip);
+	}
+}
+
+/*
+ * Fetch and dispatch every instruction straight from memory through
+ * flat_handlers. Nothing is cached per address, so writes to code need no
+ * invalidation, and the operands are extracted again at every step.
+ */
+static void run_flat(Chip8* chip, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		uint16_t opcode = (chip->memory[chip->pc & CHIP8_ADDRESS_MASK] << 8u) | chip->memory[(chip->pc + 1) & CHIP8_ADDRESS_MASK];
+		Chip8Instruction instruction;
+		decode_operands(opcode, &instruction);
+
+		chip->opcode = opcode;
+		chip->pc += 2;
+
+		flat_handlers[opcode](chip, &instruction);
+
+		chip->instruction_count++;
+	}
+}
+
+static int is_any_key_pressed(Chip8* chip) {
+	for (uint8_t key = 0; key < CHIP8_KEYPAD_SIZE; key++) {
+		if (chip->keypad[key]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void run(Chip8* chip, uint32_t count) {
+	// Keys only change between calls, so until one is pressed every
+	// instruction would be the same fx0a waiting again.
+	if (chip->waiting_for_key && !is_any_key_pressed(chip)) {
+		chip->instruction_count += count;
+		update_timers(chip);
+		return;
+	}
+
+	switch (chip->engine) {
+		case CHIP8_ENGINE_THREADED:
+			run_threaded(chip, count);
+			break;
+
+		case CHIP8_ENGINE_JIT:
+			run_jit(chip, count);
+			break;
+
+		case CHIP8_ENGINE_AOT:
+			run_aot(chip, count);
+			break;
+
+		case CHIP8_ENGINE_FLAT:
+			run_flat(chip, count);
+			break;
+
+		default:
+			run_table(chip, count);
+			break;
+	}
+
+	update_timers(chip);
+}
+
+void update_timers(Chip8* chip) {
+	if (!chip->instructions_per_tick) {
+		return;
+	}
+
+	uint64_t ticks = (chip->instruction_count - chip->timers_updated_at) / chip->instructions_per_tick;
+
+	if (!ticks) {
+		return;
+	}
+
+	chip->timers_updated_at += ticks * chip->instructions_per_tick;
+	chip->delay_timer = chip->delay_timer > ticks ? chip->delay_timer - ticks : 0;
+	chip->sound_timer = chip->sound_timer > ticks ? chip->sound_timer - ticks : 0;
+}
+
+int ends_block(uint8_t op) {
+	switch (op) {
+		case CHIP8_OP_00EE:
+		case CHIP8_OP_1NNN:
+		case CHIP8_OP_2NNN:
+		case CHIP8_OP_3XKK:
+		case CHIP8_OP_4XKK:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_BNNN:
+		case CHIP8_OP_DXYN:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+		case CHIP8_OP_FX0A:
+		case CHIP8_OP_FX33:
+		case CHIP8_OP_FX55:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Whether the chip sits on a jump to itself, which no timer or key can get it
+ * out of.
+ */
+int is_halted(Chip8* chip) {
+	return chip->pc < CHIP8_MEMORY_SIZE - 1 && fetch_opcode(chip, chip->pc) == (0x1000u | chip->pc);
+}
+
+void invalidate_decoded(Chip8* chip, uint16_t address, uint16_t length) {
+	address &= CHIP8_ADDRESS_MASK;
+
+	// A write past the end of memory lands at its start, and the instruction
+	// at the last address takes its second byte from there.
+	if ((uint32_t) address + length > CHIP8_MEMORY_SIZE) {
+		invalidate_decoded(chip, 0, address + length - CHIP8_MEMORY_SIZE);
+		length = CHIP8_MEMORY_SIZE - address;
+	}
+	if (!address && length) {
+		chip->decoded[CHIP8_ADDRESS_MASK].handler = NULL;
+	}
 
-	if (chip->delay_timer > 0) {
-		chip->delay_timer--;
+	// An instruction spans two bytes, so the one starting right before the
+	// written range is stale as well. A fused sequence spans up to
+	// CHIP8_FUSED_MAX_LENGTH instructions, so its decoded entry is stale when
+	// any of them is written.
+	uint16_t span = 2 * CHIP8_FUSED_MAX_LENGTH - 1;
+	uint16_t fused_first = address > span ? address - span : 0;
+	uint16_t first = address > 0 ? address - 1 : 0;
+	uint32_t last = (uint32_t) address + length;
+
+	if (last > CHIP8_MEMORY_SIZE) {
+		last = CHIP8_MEMORY_SIZE;
 	}
 
-	if (chip->sound_timer > 0) {
-		chip->sound_timer--;
+	for (uint32_t i = fused_first; i < last; i++) {
+		chip->decoded[i].handler = NULL;
+	}
+
+	if (first < last) {
+		for (uint32_t page = first / CHIP8_PAGE_SIZE; page <= (last - 1) / CHIP8_PAGE_SIZE; page++) {
+			chip->page_version[page]++;
+		}
+	}
+}
+
+void expand_video(Chip8* chip, uint32_t* pixels) {
+	for (uint8_t y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
+		uint64_t row = chip->video[y];
+
+		for (uint8_t x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
+			pixels[y * CHIP8_SCREEN_WIDTH + x] = (row >> (63u - x)) & 0x1u ? CHIP8_PIXEL_ON : 0;
+		}
 	}
 }
 
 void destroy(Chip8* chip) {
+	if (!chip) {
+		return;
+	}
+
+	jit_destroy(chip->jit);
+	aot_destroy(chip->aot);
 	free(chip);
 }
 
-uint8_t generate_random_byte(void) {
-	uint8_t random_byte;
-	FILE* dev_random = fopen("/dev/random", "r");
-	fread(&random_byte, sizeof(uint8_t), 1, dev_random);
-	fclose(dev_random);
+// The decoded instructions of pages that are the same in both machines are
+// still valid, so a chip reset to the ROM it already ran only decodes again
+// what the ROM wrote over.
+void load_machine(Chip8* chip, const uint8_t* machine) {
+	const uint8_t* memory = machine + offsetof(Chip8, memory);
+
+	for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; page++) {
+		uint16_t address = page * CHIP8_PAGE_SIZE;
+		if (memcmp(&chip->memory[address], &memory[address], CHIP8_PAGE_SIZE)) {
+			invalidate_decoded(chip, address, CHIP8_PAGE_SIZE);
+		}
+	}
+
+	memcpy(chip, machine, CHIP8_MACHINE_SIZE);
+}
+
+void chip8_reset(Chip8* chip, const Chip8* pristine) {
+	load_machine(chip, (const uint8_t*) pristine);
+	chip->id = next_id();
+}
+
+/*
+ * Every write to memory bumps the version of its page, so a page whose
+ * version neither chip changed since the last clone of the same parent is
+ * still the same in both and is left alone. Everything but memory is a few
+ * hundred bytes, the packed video included, and is copied every time. The
+ * parent must not run while it is being cloned.
+ */
+void chip8_clone(Chip8* child, const Chip8* parent) {
+	int same_parent = parent->id && child->clone_parent == parent->id;
+
+	for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; page++) {
+		if (same_parent && parent->page_version[page] == child->clone_parent_version[page]
+				&& child->page_version[page] == child->clone_version[page]) {
+			continue;
+		}
+
+		uint16_t address = page * CHIP8_PAGE_SIZE;
+		if (memcmp(&child->memory[address], &parent->memory[address], CHIP8_PAGE_SIZE)) {
+			memcpy(&child->memory[address], &parent->memory[address], CHIP8_PAGE_SIZE);
+			invalidate_decoded(child, address, CHIP8_PAGE_SIZE);
+		}
+	}
+
+	size_t registers_end = offsetof(Chip8, memory);
+	size_t memory_end = offsetof(Chip8, memory) + CHIP8_MEMORY_SIZE;
+	memcpy(child, parent, registers_end);
+	memcpy((uint8_t*) child + memory_end, (const uint8_t*) parent + memory_end, CHIP8_MACHINE_SIZE - memory_end);
+
+	child->clone_parent = parent->id;
+	memcpy(child->clone_parent_version, parent->page_version, sizeof(child->clone_parent_version));
+	memcpy(child->clone_version, child->page_version, sizeof(child->clone_version));
+}
+
+void seed_random(Chip8* chip, uint64_t seed) {
+	chip->random_state = 0;
+	generate_random_byte(chip);
+	chip->random_state += seed;
+	generate_random_byte(chip);
+}
+
+uint8_t generate_random_byte(Chip8* chip) {
+	return next_random_byte(&chip->random_state);
+}
+
+// PCG32, keeping the top bits of the output for the byte.
+uint8_t next_random_byte(uint64_t* random_state) {
+	uint64_t state = *random_state;
+	*random_state = state * 6364136223846793005ull + 1442695040888963407ull;
+
+	uint32_t xorshifted = ((state >> 18u) ^ state) >> 27u;
+	uint32_t rotation = state >> 59u;
+	uint32_t output = (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31u));
 
-	return random_byte;
+	return output >> 24u;
 }
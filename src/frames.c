@@ -0,0 +1,58 @@
+#include <string.h>
+#include "../inc/frames.h"
+
+#define CHIP8_FRAME_FRESH 0x80u
+#define CHIP8_FRAME_INDEX 0x7fu
+
+void frames_init(Chip8Frames* frames) {
+	memset(frames, 0, sizeof(*frames));
+
+	frames->back = 0;
+	atomic_init(&frames->handover, 1);
+	frames->front = 2;
+}
+
+Chip8Frame* frames_back(Chip8Frames* frames) {
+	return &frames->frames[frames->back];
+}
+
+void frames_publish(Chip8Frames* frames) {
+	frames->frames[frames->back].sequence = ++frames->published;
+
+	// Releases the writes to the frame to the reader, and acquires the frame
+	// it gets back once the reader is done with it.
+	uint8_t handover = atomic_exchange_explicit(&frames->handover, frames->back | CHIP8_FRAME_FRESH, memory_order_acq_rel);
+
+	frames->back = handover & CHIP8_FRAME_INDEX;
+}
+
+void publish_video(Chip8Frames* frames, Chip8* chip) {
+	Chip8Frame* frame = frames_back(frames);
+
+	expand_video(chip, frame->pixels);
+	frame->dirty_rows = chip->dirty_rows;
+	chip->dirty_rows = 0;
+
+	frames_publish(frames);
+}
+
+Chip8Frame* frames_take(Chip8Frames* frames) {
+	// Only the reader clears the fresh bit, so it is still set at the exchange.
+	if (!(atomic_load_explicit(&frames->handover, memory_order_acquire) & CHIP8_FRAME_FRESH)) {
+		return NULL;
+	}
+
+	uint8_t handover = atomic_exchange_explicit(&frames->handover, frames->front, memory_order_acq_rel);
+	Chip8Frame* frame = &frames->frames[handover & CHIP8_FRAME_INDEX];
+
+	frames->front = handover & CHIP8_FRAME_INDEX;
+
+	// Dirty rows only go back one frame, so after a skipped one every row has
+	// to be redrawn.
+	if (frame->sequence != frames->taken + 1) {
+		frame->dirty_rows = 0xffffffff;
+	}
+	frames->taken = frame->sequence;
+
+	return frame;
+}
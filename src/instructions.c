@@ -1,99 +1,103 @@
 #include <string.h>
 #include "../inc/instructions.h"
 
-void op_00e0(Chip8* chip) {
+void op_invalid(Chip8* chip, const Chip8Instruction* instruction) {}
+
+void op_00e0(Chip8* chip, const Chip8Instruction* instruction) {
 	memset(chip->video, 0, sizeof(chip->video));
+	chip->dirty_rows = 0xffffffff;
 }
 
-void op_00ee(Chip8* chip) {
-	chip->pc = chip->stack[--chip->sp];
+void op_00ee(Chip8* chip, const Chip8Instruction* instruction) {
+	chip->sp--;
+	chip->pc = chip->stack[chip->sp % CHIP8_STACK_SIZE];
 }
 
-void op_1nnn(Chip8* chip) {
-	uint16_t address = chip->opcode & 0x0fffu;
+void op_1nnn(Chip8* chip, const Chip8Instruction* instruction) {
+	uint16_t address = instruction->nnn;
 	chip->pc = address;
 }
 
-void op_2nnn(Chip8* chip) {
-	uint16_t address = chip->opcode & 0x0fffu;
+void op_2nnn(Chip8* chip, const Chip8Instruction* instruction) {
+	uint16_t address = instruction->nnn;
 
-	chip->stack[chip->sp] = chip->pc;
+	chip->stack[chip->sp % CHIP8_STACK_SIZE] = chip->pc;
 	chip->sp++;
 	chip->pc = address;
 }
 
-void op_3xkk(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t kk = (chip->opcode & 0x00ffu);
+void op_3xkk(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t kk = instruction->kk;
 
 	if (chip->registers[vx] == kk) {
 		chip->pc += 2;
 	}
 }
 
-void op_4xkk(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t kk = (chip->opcode & 0x00ffu);
+void op_4xkk(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t kk = instruction->kk;
 
 	if (chip->registers[vx] != kk) {
 		chip->pc += 2;
 	}
 }
 
-void op_5xy0(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_5xy0(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	if (chip->registers[vx] == chip->registers[vy]) {
 		chip->pc += 2;
 	}
 }
 
-void op_6xkk(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t kk = (chip->opcode & 0x00ffu);
+void op_6xkk(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t kk = instruction->kk;
 
 	chip->registers[vx] = kk;
 }
 
-void op_7xkk(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t kk = (chip->opcode & 0x00ffu);
+void op_7xkk(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t kk = instruction->kk;
 
 	chip->registers[vx] += kk;
 }
 
-void op_8xy0(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy0(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	chip->registers[vx] = chip->registers[vy];
 }
 
-void op_8xy1(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy1(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	chip->registers[vx] |= chip->registers[vy];
 }
 
-void op_8xy2(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy2(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	chip->registers[vx] &= chip->registers[vy];
 }
 
-void op_8xy3(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy3(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	chip->registers[vx] ^= chip->registers[vy];
 }
 
-void op_8xy4(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy4(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	uint16_t sum = chip->registers[vx] + chip->registers[vy];
 
@@ -106,9 +110,9 @@ void op_8xy4(Chip8* chip) {
 	chip->registers[vx] = sum & 0x00ffu;
 }
 
-void op_8xy5(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy5(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	if (chip->registers[vx] > chip->registers[vy]) {
 		chip->registers[0xf] = 1;
@@ -119,17 +123,17 @@ void op_8xy5(Chip8* chip) {
 	chip->registers[vx] -= chip->registers[vy];
 }
 
-void op_8xy6(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_8xy6(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	chip->registers[0xf] = (chip->registers[vx] & 0x0001u);
 
 	chip->registers[vx] >>= 1;
 }
 
-void op_8xy7(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_8xy7(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	if (chip->registers[vy] > chip->registers[vx]) {
 		chip->registers[0xf] = 1;
@@ -140,8 +144,8 @@ void op_8xy7(Chip8* chip) {
 	chip->registers[vx] = chip->registers[vy] - chip->registers[vx];
 }
 
-void op_8xye(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_8xye(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	uint8_t most_significant_bit_of_vx = chip->registers[vx] >> 7u;
 	chip->registers[0xf] = most_significant_bit_of_vx;
@@ -149,36 +153,36 @@ void op_8xye(Chip8* chip) {
 	chip->registers[vx] <<= 1;
 }
 
-void op_9xy0(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
+void op_9xy0(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
 
 	if (chip->registers[vx] != chip->registers[vy]) {
 		chip->pc += 2;
 	}
 }
 
-void op_annn(Chip8* chip) {
-	chip->index = chip->opcode & 0x0fffu;
+void op_annn(Chip8* chip, const Chip8Instruction* instruction) {
+	chip->index = instruction->nnn;
 }
 
-void op_bnnn(Chip8* chip) {
-	chip->pc = chip->registers[0x0] + (chip->opcode & 0x0fffu);
+void op_bnnn(Chip8* chip, const Chip8Instruction* instruction) {
+	chip->pc = chip->registers[0x0] + instruction->nnn;
 }
 
-void op_cxkk(Chip8* chip, uint8_t (*byte_generator_function)()) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t kk = chip->opcode & 0x00ffu;
+void op_cxkk(Chip8* chip, const Chip8Instruction* instruction, uint8_t (*byte_generator_function)(Chip8*)) {
+	uint8_t vx = instruction->x;
+	uint8_t kk = instruction->kk;
 
-	uint8_t random_byte = (*byte_generator_function)();
+	uint8_t random_byte = (*byte_generator_function)(chip);
 
 	chip->registers[vx] = random_byte & kk;
 }
 
-void op_dxyn(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
-	uint8_t vy = (chip->opcode & 0x00f0u) >> 4u;
-	uint8_t n = chip->opcode & 0x000fu;
+void op_dxyn(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
+	uint8_t vy = instruction->y;
+	uint8_t n = instruction->n;
 
 	uint8_t x_start = chip->registers[vx] % CHIP8_SCREEN_WIDTH;
 	uint8_t y_start = chip->registers[vy] % CHIP8_SCREEN_HEIGHT;
@@ -186,51 +190,55 @@ void op_dxyn(Chip8* chip) {
 	chip->registers[0xf] = 0x00;
 
 	for (uint8_t row = 0; row < n; row++) {
-		uint8_t sprite_byte = chip->memory[chip->index + row];
+		uint8_t y = (y_start + row) % CHIP8_SCREEN_HEIGHT;
+		uint64_t sprite_row = (uint64_t) chip->memory[(chip->index + row) & CHIP8_ADDRESS_MASK] << 56u;
+		uint64_t* screen_row = &chip->video[y];
 
-		for (uint8_t column = 0; column < 8; column++) {
-			uint8_t sprite_pixel = sprite_byte & (0x80u >> column);
-			uint32_t* screen_pixel = &chip->video[(y_start + row) * CHIP8_SCREEN_WIDTH + (x_start + column)];
+		// Rotating instead of shifting wraps the sprite around the screen.
+		if (x_start) {
+			sprite_row = (sprite_row >> x_start) | (sprite_row << (CHIP8_SCREEN_WIDTH - x_start));
+		}
 
-			if (sprite_pixel) {
-				if (*screen_pixel == 0xffffffff) {
-					chip->registers[0xf] = 0x01;
-				}
+		if (*screen_row & sprite_row) {
+			chip->registers[0xf] = 0x01;
+		}
 
-				*screen_pixel ^= 0xffffffff;
-			}
+		if (sprite_row) {
+			*screen_row ^= sprite_row;
+			chip->dirty_rows |= 1u << y;
 		}
 	}
 }
 
-void op_ex9e(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_ex9e(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
-	uint8_t key = chip->registers[vx];
+	uint8_t key = chip->registers[vx] % CHIP8_KEYPAD_SIZE;
 
 	if (chip->keypad[key]) {
 		chip->pc += 2;
 	}
 }
 
-void op_exa1(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_exa1(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
-	uint8_t key = chip->registers[vx];
+	uint8_t key = chip->registers[vx] % CHIP8_KEYPAD_SIZE;
 
 	if (!chip->keypad[key]) {
 		chip->pc += 2;
 	}
 }
 
-void op_fx07(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx07(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
+	update_timers(chip);
 	chip->registers[vx] = chip->delay_timer;
 }
 
-void op_fx0a(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx0a(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	if (chip->keypad[0x0]) {
 		chip->registers[vx] = 0x0;
@@ -265,59 +273,69 @@ void op_fx0a(Chip8* chip) {
 	} else if (chip->keypad[0xf]) {
 		chip->registers[vx] = 0xf;
 	} else {
-		chip->opcode -= 2;
+		chip->pc -= 2;
+		chip->waiting_for_key = 1;
+		return;
 	}
+
+	chip->waiting_for_key = 0;
 }
 
-void op_fx15(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx15(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
+	update_timers(chip);
 	chip->delay_timer = chip->registers[vx];
 }
 
-void op_fx18(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx18(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
+	update_timers(chip);
 	chip->sound_timer = chip->registers[vx];
 }
 
-void op_fx1e(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx1e(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	chip->index += chip->registers[vx];
 }
 
-void op_fx29(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx29(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	chip->index = CHIP8_FONT_SET_START_ADDRESS + (5 * chip->registers[vx]);
 }
 
-void op_fx33(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx33(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 	uint8_t vx_value = chip->registers[vx];
 
-	chip->memory[chip->index + 2] = vx_value % 10;
+	chip->memory[(chip->index + 2) & CHIP8_ADDRESS_MASK] = vx_value % 10;
 	vx_value /= 10;
 
-	chip->memory[chip->index + 1] = vx_value % 10;
+	chip->memory[(chip->index + 1) & CHIP8_ADDRESS_MASK] = vx_value % 10;
 	vx_value /= 10;
 
-	chip->memory[chip->index] = vx_value % 10;
+	chip->memory[chip->index & CHIP8_ADDRESS_MASK] = vx_value % 10;
+
+	invalidate_decoded(chip, chip->index, 3);
 }
 
-void op_fx55(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx55(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	for (uint8_t i = 0; i <= vx; i++) {
-		chip->memory[chip->index + i] = chip->registers[i];
+		chip->memory[(chip->index + i) & CHIP8_ADDRESS_MASK] = chip->registers[i];
 	}
+
+	invalidate_decoded(chip, chip->index, vx + 1);
 }
 
-void op_fx65(Chip8* chip) {
-	uint8_t vx = (chip->opcode & 0x0f00u) >> 8u;
+void op_fx65(Chip8* chip, const Chip8Instruction* instruction) {
+	uint8_t vx = instruction->x;
 
 	for (uint8_t i = 0; i <= vx; i++) {
-		chip->registers[i] = chip->memory[chip->index + i];
+		chip->registers[i] = chip->memory[(chip->index + i) & CHIP8_ADDRESS_MASK];
 	}
 }
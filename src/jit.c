@@ -0,0 +1,420 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "../inc/jit.h"
+#include "../inc/threaded.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_BUFFER_SIZE (1024 * 1024)
+#define JIT_MAX_BLOCK_LENGTH 64
+#define JIT_MAX_INSTRUCTION_SIZE 96
+
+#define REGISTER(x) ((int32_t) (offsetof(Chip8, registers) + (x)))
+#define FIELD(name) ((int32_t) offsetof(Chip8, name))
+
+typedef struct JitBlock {
+	void (*code)(Chip8*);
+	uint32_t version;
+	uint16_t length;
+	uint8_t compiled;
+} JitBlock;
+
+// The operands of an instruction that calls its handler live at its address
+// for as long as the block compiled with it is valid. The buffer is never
+// writable and executable at once: only the pages a block is being emitted
+// into are writable, until it is done. It is NULL when the system refuses
+// executable memory, and the chip runs threaded instead.
+typedef struct Chip8Jit {
+	uint8_t* buffer;
+	size_t used;
+	JitBlock blocks[CHIP8_MEMORY_SIZE];
+	Chip8Instruction operands[CHIP8_MEMORY_SIZE];
+} Chip8Jit;
+
+static Chip8Jit* jit_create(void) {
+	Chip8Jit* jit = calloc(1, sizeof(Chip8Jit));
+
+	if (!jit) {
+		return NULL;
+	}
+
+	jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (jit->buffer == MAP_FAILED) {
+		jit->buffer = NULL;
+	} else if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC)) {
+		munmap(jit->buffer, JIT_BUFFER_SIZE);
+		jit->buffer = NULL;
+	}
+
+	return jit;
+}
+
+void jit_destroy(Chip8Jit* jit) {
+	if (!jit) {
+		return;
+	}
+
+	if (jit->buffer) {
+		munmap(jit->buffer, JIT_BUFFER_SIZE);
+	}
+	free(jit);
+}
+
+// Switch the pages holding [start, end) of the buffer between writable and
+// executable.
+static int protect(Chip8Jit* jit, size_t start, size_t end, int protection) {
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t first = start / page_size * page_size;
+	size_t last = (end + page_size - 1) / page_size * page_size;
+
+	if (last > JIT_BUFFER_SIZE) {
+		last = JIT_BUFFER_SIZE;
+	}
+
+	return mprotect(jit->buffer + first, last - first, protection);
+}
+
+// Stop translating for good, for instance once the system refuses to make
+// emitted code executable again.
+static void disable(Chip8Jit* jit) {
+	munmap(jit->buffer, JIT_BUFFER_SIZE);
+	jit->buffer = NULL;
+}
+
+static void emit8(Chip8Jit* jit, uint8_t value) {
+	jit->buffer[jit->used++] = value;
+}
+
+static void emit16(Chip8Jit* jit, uint16_t value) {
+	emit8(jit, value & 0xffu);
+	emit8(jit, value >> 8u);
+}
+
+static void emit32(Chip8Jit* jit, uint32_t value) {
+	emit16(jit, value & 0xffffu);
+	emit16(jit, value >> 16u);
+}
+
+static void emit64(Chip8Jit* jit, uint64_t value) {
+	emit32(jit, value & 0xffffffffu);
+	emit32(jit, value >> 32u);
+}
+
+/*
+ * The chip pointer lives in rbx for the whole block, so every guest field is
+ * addressed as [rbx + disp32]. reg is the ModRM reg field: a register number
+ * or an opcode extension.
+ */
+static void emit_chip_operand(Chip8Jit* jit, uint8_t reg, int32_t displacement) {
+	emit8(jit, 0x83u | (reg << 3u));
+	emit32(jit, displacement);
+}
+
+// mov al, [rbx + displacement]
+static void emit_load_al(Chip8Jit* jit, int32_t displacement) {
+	emit8(jit, 0x8a);
+	emit_chip_operand(jit, 0, displacement);
+}
+
+// mov [rbx + displacement], al
+static void emit_store_al(Chip8Jit* jit, int32_t displacement) {
+	emit8(jit, 0x88);
+	emit_chip_operand(jit, 0, displacement);
+}
+
+// mov [rbx + displacement], cl
+static void emit_store_cl(Chip8Jit* jit, int32_t displacement) {
+	emit8(jit, 0x88);
+	emit_chip_operand(jit, 1, displacement);
+}
+
+// mov word [rbx + displacement], value
+static void emit_store_word(Chip8Jit* jit, int32_t displacement, uint16_t value) {
+	emit8(jit, 0x66);
+	emit8(jit, 0xc7);
+	emit_chip_operand(jit, 0, displacement);
+	emit16(jit, value);
+}
+
+// add qword [rbx + instruction_count], count
+static void emit_instruction_count(Chip8Jit* jit, uint8_t count) {
+	if (!count) {
+		return;
+	}
+
+	emit8(jit, 0x48);
+	emit8(jit, 0x81);
+	emit_chip_operand(jit, 0, FIELD(instruction_count));
+	emit32(jit, count);
+}
+
+static void emit_call(Chip8Jit* jit, Chip8Handler handler, const Chip8Instruction* instruction) {
+	emit8(jit, 0x48); // mov rdi, rbx
+	emit8(jit, 0x89);
+	emit8(jit, 0xdf);
+	emit8(jit, 0x48); // mov rsi, instruction
+	emit8(jit, 0xbe);
+	emit64(jit, (uint64_t) (uintptr_t) instruction);
+	emit8(jit, 0x48); // mov rax, handler
+	emit8(jit, 0xb8);
+	emit64(jit, (uint64_t) (uintptr_t) handler);
+	emit8(jit, 0xff); // call rax
+	emit8(jit, 0xd0);
+}
+
+/*
+ * Emit the native version of an instruction, keeping the exact order of reads
+ * and writes of the op_* handler so that VF as an operand behaves the same.
+ * Returns 0 when the instruction has to go through its handler instead.
+ */
+static int emit_native(Chip8Jit* jit, Chip8Instruction* instruction) {
+	int32_t vx = REGISTER(instruction->x);
+	int32_t vy = REGISTER(instruction->y);
+	int32_t vf = REGISTER(0xf);
+
+	switch (instruction->op) {
+		case CHIP8_OP_NULL:
+			return 1;
+
+		case CHIP8_OP_1NNN:
+			emit_store_word(jit, FIELD(pc), instruction->nnn);
+			return 1;
+
+		case CHIP8_OP_6XKK:
+			emit8(jit, 0xc6); // mov byte [vx], kk
+			emit_chip_operand(jit, 0, vx);
+			emit8(jit, instruction->kk);
+			return 1;
+
+		case CHIP8_OP_7XKK:
+			emit8(jit, 0x80); // add byte [vx], kk
+			emit_chip_operand(jit, 0, vx);
+			emit8(jit, instruction->kk);
+			return 1;
+
+		case CHIP8_OP_8XY0:
+			emit_load_al(jit, vy);
+			emit_store_al(jit, vx);
+			return 1;
+
+		case CHIP8_OP_8XY1:
+		case CHIP8_OP_8XY2:
+		case CHIP8_OP_8XY3: {
+			uint8_t opcodes[] = { 0x08, 0x20, 0x30 }; // or, and, xor [vx], al
+			emit_load_al(jit, vy);
+			emit8(jit, opcodes[instruction->op - CHIP8_OP_8XY1]);
+			emit_chip_operand(jit, 0, vx);
+			return 1;
+		}
+
+		case CHIP8_OP_8XY4:
+			emit_load_al(jit, vx);
+			emit8(jit, 0x02); // add al, [vy]
+			emit_chip_operand(jit, 0, vy);
+			emit8(jit, 0x0f); // setc cl
+			emit8(jit, 0x92);
+			emit8(jit, 0xc1);
+			emit_store_cl(jit, vf);
+			emit_store_al(jit, vx);
+			return 1;
+
+		case CHIP8_OP_8XY5:
+		case CHIP8_OP_8XY7: {
+			int32_t minuend = instruction->op == CHIP8_OP_8XY5 ? vx : vy;
+			int32_t subtrahend = instruction->op == CHIP8_OP_8XY5 ? vy : vx;
+			emit_load_al(jit, minuend);
+			emit8(jit, 0x3a); // cmp al, [subtrahend]
+			emit_chip_operand(jit, 0, subtrahend);
+			emit8(jit, 0x0f); // seta cl
+			emit8(jit, 0x97);
+			emit8(jit, 0xc1);
+			emit_store_cl(jit, vf);
+			emit_load_al(jit, minuend);
+			emit8(jit, 0x2a); // sub al, [subtrahend]
+			emit_chip_operand(jit, 0, subtrahend);
+			emit_store_al(jit, vx);
+			return 1;
+		}
+
+		case CHIP8_OP_8XY6:
+			emit_load_al(jit, vx);
+			emit8(jit, 0x24); // and al, 1
+			emit8(jit, 0x01);
+			emit_store_al(jit, vf);
+			emit8(jit, 0xd0); // shr byte [vx], 1
+			emit_chip_operand(jit, 5, vx);
+			return 1;
+
+		case CHIP8_OP_8XYE:
+			emit_load_al(jit, vx);
+			emit8(jit, 0xc0); // shr al, 7
+			emit8(jit, 0xe8);
+			emit8(jit, 0x07);
+			emit_store_al(jit, vf);
+			emit8(jit, 0xd0); // shl byte [vx], 1
+			emit_chip_operand(jit, 4, vx);
+			return 1;
+
+		case CHIP8_OP_ANNN:
+			emit_store_word(jit, FIELD(index), instruction->nnn);
+			return 1;
+
+		case CHIP8_OP_FX1E:
+			emit8(jit, 0x0f); // movzx eax, byte [vx]
+			emit8(jit, 0xb6);
+			emit_chip_operand(jit, 0, vx);
+			emit8(jit, 0x66); // add [index], ax
+			emit8(jit, 0x01);
+			emit_chip_operand(jit, 0, FIELD(index));
+			return 1;
+
+		case CHIP8_OP_FX29:
+			emit8(jit, 0x0f); // movzx eax, byte [vx]
+			emit8(jit, 0xb6);
+			emit_chip_operand(jit, 0, vx);
+			emit8(jit, 0x8d); // lea eax, [rax + rax * 4 + font]
+			emit8(jit, 0x44);
+			emit8(jit, 0x80);
+			emit8(jit, CHIP8_FONT_SET_START_ADDRESS);
+			emit8(jit, 0x66); // mov [index], ax
+			emit8(jit, 0x89);
+			emit_chip_operand(jit, 0, FIELD(index));
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+static void compile(Chip8* chip, Chip8Jit* jit, uint16_t address, JitBlock* block) {
+	uint16_t page = address / CHIP8_PAGE_SIZE;
+
+	block->compiled = 1;
+	block->version = chip->page_version[page];
+	block->code = NULL;
+	block->length = 0;
+
+	if ((address + 1) / CHIP8_PAGE_SIZE != page) {
+		return;
+	}
+
+	if (jit->used + JIT_MAX_BLOCK_LENGTH * JIT_MAX_INSTRUCTION_SIZE > JIT_BUFFER_SIZE) {
+		for (uint32_t i = 0; i < CHIP8_MEMORY_SIZE; i++) {
+			jit->blocks[i].compiled = 0;
+		}
+		block->compiled = 1;
+		jit->used = 0;
+	}
+
+	size_t start = jit->used;
+	size_t end = start + JIT_MAX_BLOCK_LENGTH * JIT_MAX_INSTRUCTION_SIZE;
+	if (protect(jit, start, end, PROT_READ | PROT_WRITE)) {
+		disable(jit);
+		return;
+	}
+
+	uint8_t* code = &jit->buffer[jit->used];
+	uint8_t pending_instructions = 0;
+	int opcode_stored = 0;
+	int pc_stored = 0;
+	Chip8Instruction instruction;
+
+	emit8(jit, 0x53); // push rbx
+	emit8(jit, 0x48); // mov rbx, rdi
+	emit8(jit, 0x89);
+	emit8(jit, 0xfb);
+
+	while (block->length < JIT_MAX_BLOCK_LENGTH && (address + 1) / CHIP8_PAGE_SIZE == page) {
+		decode(chip, address, &instruction);
+		address += 2;
+		block->length++;
+
+		if (emit_native(jit, &instruction)) {
+			opcode_stored = 0;
+			pc_stored = instruction.op == CHIP8_OP_1NNN;
+		} else {
+			emit_instruction_count(jit, pending_instructions);
+			pending_instructions = 0;
+			emit_store_word(jit, FIELD(opcode), instruction.opcode);
+			emit_store_word(jit, FIELD(pc), address);
+			jit->operands[address - 2] = instruction;
+			emit_call(jit, instruction.handler, &jit->operands[address - 2]);
+			opcode_stored = 1;
+			pc_stored = 1;
+		}
+
+		pending_instructions++;
+
+		if (ends_block(instruction.op)) {
+			break;
+		}
+	}
+
+	if (!opcode_stored) {
+		emit_store_word(jit, FIELD(opcode), instruction.opcode);
+	}
+
+	if (!pc_stored) {
+		emit_store_word(jit, FIELD(pc), address);
+	}
+
+	emit_instruction_count(jit, pending_instructions);
+
+	emit8(jit, 0x5b); // pop rbx
+	emit8(jit, 0xc3); // ret
+
+	if (protect(jit, start, end, PROT_READ | PROT_EXEC)) {
+		disable(jit);
+		return;
+	}
+
+	block->code = (void (*)(Chip8*)) code;
+}
+
+void run_jit(Chip8* chip, uint32_t count) {
+	if (!chip->jit) {
+		chip->jit = jit_create();
+	}
+
+	while (count) {
+		if (!chip->jit || !chip->jit->buffer) {
+			run_threaded(chip, count);
+			return;
+		}
+
+		uint16_t pc = chip->pc;
+		JitBlock* block = NULL;
+
+		if (pc < CHIP8_MEMORY_SIZE) {
+			block = &chip->jit->blocks[pc];
+
+			if (!block->compiled || block->version != chip->page_version[pc / CHIP8_PAGE_SIZE]) {
+				compile(chip, chip->jit, pc, block);
+				continue;
+			}
+		}
+
+		if (!block || !block->code || block->length > count) {
+			cycle(chip);
+			count--;
+			continue;
+		}
+
+		block->code(chip);
+		count -= block->length;
+	}
+}
+
+#else
+
+void run_jit(Chip8* chip, uint32_t count) {
+	run_threaded(chip, count);
+}
+
+void jit_destroy(struct Chip8Jit* jit) {}
+
+#endif /* __x86_64__ && __unix__ */
@@ -0,0 +1,707 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/lockstep.h"
+
+#define ADDRESS_MASK (CHIP8_MEMORY_SIZE - 1)
+// Lanes 4 KiB apart would all share the same cache sets, so each memory is
+// followed by one unused cache line.
+#define MEMORY_STRIDE (CHIP8_MEMORY_SIZE + 64)
+
+#define REGISTER(lockstep, register, lane) ((lockstep)->registers[(register) * (lockstep)->stride + (lane)])
+#define KEY(lockstep, key, lane) ((lockstep)->keypad[(key) * (lockstep)->stride + (lane)])
+#define MEMORY(lockstep, lane) (&(lockstep)->memory[(size_t) (lane) * MEMORY_STRIDE])
+#define PAGE_BIT(address) (1u << ((address) / CHIP8_PAGE_SIZE))
+#define STACK(lockstep, lane) (&(lockstep)->stack[(size_t) (lane) * CHIP8_STACK_SIZE])
+#define VIDEO(lockstep, lane) (&(lockstep)->video[(size_t) (lane) * CHIP8_SCREEN_HEIGHT])
+
+static void* allocate_lanes(size_t size) {
+	size = (size + CHIP8_LOCKSTEP_VECTOR_SIZE - 1) / CHIP8_LOCKSTEP_VECTOR_SIZE * CHIP8_LOCKSTEP_VECTOR_SIZE;
+
+	void* lanes = aligned_alloc(CHIP8_LOCKSTEP_VECTOR_SIZE, size);
+	if (lanes) {
+		memset(lanes, 0, size);
+	}
+
+	return lanes;
+}
+
+Chip8Lockstep* create_lockstep(uint32_t lane_count) {
+	Chip8Lockstep* lockstep = calloc(1, sizeof(Chip8Lockstep));
+	if (!lockstep) {
+		return NULL;
+	}
+
+	uint32_t stride = (lane_count + CHIP8_LOCKSTEP_VECTOR_SIZE - 1) / CHIP8_LOCKSTEP_VECTOR_SIZE * CHIP8_LOCKSTEP_VECTOR_SIZE;
+	lockstep->lane_count = lane_count;
+	lockstep->stride = stride;
+
+	lockstep->registers = allocate_lanes((size_t) stride * CHIP8_REGISTER_COUNT);
+	lockstep->keypad = allocate_lanes((size_t) stride * CHIP8_KEYPAD_SIZE);
+	lockstep->waiting_for_key = allocate_lanes(stride);
+	lockstep->memory = allocate_lanes((size_t) stride * MEMORY_STRIDE);
+	lockstep->stack = allocate_lanes((size_t) stride * CHIP8_STACK_SIZE * sizeof(uint16_t));
+	lockstep->video = allocate_lanes((size_t) stride * CHIP8_SCREEN_HEIGHT * sizeof(uint64_t));
+	lockstep->index = allocate_lanes(stride * sizeof(uint16_t));
+	lockstep->pc = allocate_lanes(stride * sizeof(uint16_t));
+	lockstep->opcode = allocate_lanes(stride * sizeof(uint16_t));
+	lockstep->sp = allocate_lanes(stride);
+	lockstep->delay_timer = allocate_lanes(stride);
+	lockstep->sound_timer = allocate_lanes(stride);
+	lockstep->dirty_rows = allocate_lanes(stride * sizeof(uint32_t));
+	lockstep->instruction_count = allocate_lanes(stride * sizeof(uint64_t));
+	lockstep->timers_updated_at = allocate_lanes(stride * sizeof(uint64_t));
+	lockstep->instructions_per_tick = allocate_lanes(stride * sizeof(uint16_t));
+	lockstep->random_state = allocate_lanes(stride * sizeof(uint64_t));
+	lockstep->shared_pages = allocate_lanes(stride * sizeof(uint16_t));
+
+	if (!lockstep->registers || !lockstep->keypad || !lockstep->waiting_for_key || !lockstep->memory || !lockstep->stack
+			|| !lockstep->video || !lockstep->index || !lockstep->pc || !lockstep->opcode
+			|| !lockstep->sp || !lockstep->delay_timer || !lockstep->sound_timer
+			|| !lockstep->dirty_rows || !lockstep->instruction_count || !lockstep->timers_updated_at
+			|| !lockstep->instructions_per_tick || !lockstep->random_state || !lockstep->shared_pages) {
+		lockstep_destroy(lockstep);
+		return NULL;
+	}
+
+	Chip8* blank = create();
+	if (!blank) {
+		lockstep_destroy(lockstep);
+		return NULL;
+	}
+	for (uint32_t lane = 0; lane < stride; lane++) {
+		lockstep_load(lockstep, lane, blank);
+	}
+	destroy(blank);
+
+	return lockstep;
+}
+
+static void compare_pages(Chip8Lockstep* lockstep, uint32_t lane) {
+	uint8_t* memory = MEMORY(lockstep, lane);
+	uint8_t* first = MEMORY(lockstep, lane - lane % CHIP8_LOCKSTEP_VECTOR_SIZE);
+	uint16_t shared = 0;
+
+	for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; page++) {
+		if (!memcmp(&memory[page * CHIP8_PAGE_SIZE], &first[page * CHIP8_PAGE_SIZE], CHIP8_PAGE_SIZE)) {
+			shared |= 1u << page;
+		}
+	}
+
+	lockstep->shared_pages[lane] = shared;
+}
+
+void lockstep_load(Chip8Lockstep* lockstep, uint32_t lane, Chip8* chip) {
+	for (uint8_t i = 0; i < CHIP8_REGISTER_COUNT; i++) {
+		REGISTER(lockstep, i, lane) = chip->registers[i];
+	}
+	for (uint8_t i = 0; i < CHIP8_KEYPAD_SIZE; i++) {
+		KEY(lockstep, i, lane) = chip->keypad[i];
+	}
+	memcpy(MEMORY(lockstep, lane), chip->memory, sizeof(chip->memory));
+	memcpy(STACK(lockstep, lane), chip->stack, sizeof(chip->stack));
+	memcpy(VIDEO(lockstep, lane), chip->video, sizeof(chip->video));
+
+	lockstep->index[lane] = chip->index;
+	lockstep->pc[lane] = chip->pc;
+	lockstep->waiting_for_key[lane] = chip->waiting_for_key;
+	lockstep->opcode[lane] = chip->opcode;
+	lockstep->sp[lane] = chip->sp;
+	lockstep->delay_timer[lane] = chip->delay_timer;
+	lockstep->sound_timer[lane] = chip->sound_timer;
+	lockstep->dirty_rows[lane] = chip->dirty_rows;
+	lockstep->instruction_count[lane] = chip->instruction_count;
+	lockstep->timers_updated_at[lane] = chip->timers_updated_at;
+	lockstep->instructions_per_tick[lane] = chip->instructions_per_tick;
+	lockstep->random_state[lane] = chip->random_state;
+
+	if (lane % CHIP8_LOCKSTEP_VECTOR_SIZE) {
+		compare_pages(lockstep, lane);
+		return;
+	}
+
+	for (uint32_t i = 0; i < CHIP8_LOCKSTEP_VECTOR_SIZE; i++) {
+		compare_pages(lockstep, lane + i);
+	}
+}
+
+void lockstep_store(Chip8Lockstep* lockstep, uint32_t lane, Chip8* chip) {
+	for (uint8_t i = 0; i < CHIP8_REGISTER_COUNT; i++) {
+		chip->registers[i] = REGISTER(lockstep, i, lane);
+	}
+	for (uint8_t i = 0; i < CHIP8_KEYPAD_SIZE; i++) {
+		chip->keypad[i] = KEY(lockstep, i, lane);
+	}
+	memcpy(chip->memory, MEMORY(lockstep, lane), sizeof(chip->memory));
+	memcpy(chip->stack, STACK(lockstep, lane), sizeof(chip->stack));
+	memcpy(chip->video, VIDEO(lockstep, lane), sizeof(chip->video));
+
+	chip->index = lockstep->index[lane];
+	chip->pc = lockstep->pc[lane];
+	chip->waiting_for_key = lockstep->waiting_for_key[lane];
+	chip->opcode = lockstep->opcode[lane];
+	chip->sp = lockstep->sp[lane];
+	chip->delay_timer = lockstep->delay_timer[lane];
+	chip->sound_timer = lockstep->sound_timer[lane];
+	chip->dirty_rows = lockstep->dirty_rows[lane];
+	chip->instruction_count = lockstep->instruction_count[lane];
+	chip->timers_updated_at = lockstep->timers_updated_at[lane];
+	chip->instructions_per_tick = lockstep->instructions_per_tick[lane];
+	chip->random_state = lockstep->random_state[lane];
+
+	invalidate_decoded(chip, 0, CHIP8_MEMORY_SIZE);
+}
+
+// Same as update_timers().
+static void update_lane_timers(Chip8Lockstep* lockstep, uint32_t lane) {
+	uint16_t instructions_per_tick = lockstep->instructions_per_tick[lane];
+	if (!instructions_per_tick) {
+		return;
+	}
+
+	uint64_t ticks = (lockstep->instruction_count[lane] - lockstep->timers_updated_at[lane]) / instructions_per_tick;
+	if (!ticks) {
+		return;
+	}
+
+	lockstep->timers_updated_at[lane] += ticks * instructions_per_tick;
+	lockstep->delay_timer[lane] = lockstep->delay_timer[lane] > ticks ? lockstep->delay_timer[lane] - ticks : 0;
+	lockstep->sound_timer[lane] = lockstep->sound_timer[lane] > ticks ? lockstep->sound_timer[lane] - ticks : 0;
+}
+
+static void write_memory(Chip8Lockstep* lockstep, uint32_t lane, uint16_t address, uint8_t value) {
+	uint8_t* memory = MEMORY(lockstep, lane);
+	uint16_t page = PAGE_BIT(address & ADDRESS_MASK);
+
+	if (memory[address & ADDRESS_MASK] == value) {
+		return;
+	}
+	memory[address & ADDRESS_MASK] = value;
+
+	if (lane % CHIP8_LOCKSTEP_VECTOR_SIZE) {
+		lockstep->shared_pages[lane] &= ~page;
+		return;
+	}
+
+	// The other lanes of the group are compared against this one.
+	for (uint32_t i = 1; i < CHIP8_LOCKSTEP_VECTOR_SIZE; i++) {
+		lockstep->shared_pages[lane + i] &= ~page;
+	}
+}
+
+// The instructions of src/instructions.c, on one lane.
+static void execute_lane(Chip8Lockstep* lockstep, uint32_t lane, uint16_t opcode, Chip8Op op) {
+	uint8_t x = (opcode & 0x0f00u) >> 8u;
+	uint8_t y = (opcode & 0x00f0u) >> 4u;
+	uint8_t kk = opcode & 0x00ffu;
+	uint16_t nnn = opcode & 0x0fffu;
+
+	uint8_t* memory = MEMORY(lockstep, lane);
+	uint16_t* stack = STACK(lockstep, lane);
+	uint64_t* video = VIDEO(lockstep, lane);
+	uint16_t* pc = &lockstep->pc[lane];
+	uint16_t* index = &lockstep->index[lane];
+
+	switch (op) {
+		case CHIP8_OP_00E0:
+			memset(video, 0, CHIP8_SCREEN_HEIGHT * sizeof(uint64_t));
+			lockstep->dirty_rows[lane] = 0xffffffff;
+			break;
+
+		case CHIP8_OP_00EE:
+			lockstep->sp[lane]--;
+			*pc = stack[lockstep->sp[lane] % CHIP8_STACK_SIZE];
+			break;
+
+		case CHIP8_OP_1NNN:
+			*pc = nnn;
+			break;
+
+		case CHIP8_OP_2NNN:
+			stack[lockstep->sp[lane] % CHIP8_STACK_SIZE] = *pc;
+			lockstep->sp[lane]++;
+			*pc = nnn;
+			break;
+
+		case CHIP8_OP_3XKK:
+			if (REGISTER(lockstep, x, lane) == kk) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_4XKK:
+			if (REGISTER(lockstep, x, lane) != kk) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_5XY0:
+			if (REGISTER(lockstep, x, lane) == REGISTER(lockstep, y, lane)) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_6XKK:
+			REGISTER(lockstep, x, lane) = kk;
+			break;
+
+		case CHIP8_OP_7XKK:
+			REGISTER(lockstep, x, lane) += kk;
+			break;
+
+		case CHIP8_OP_8XY0:
+			REGISTER(lockstep, x, lane) = REGISTER(lockstep, y, lane);
+			break;
+
+		case CHIP8_OP_8XY1:
+			REGISTER(lockstep, x, lane) |= REGISTER(lockstep, y, lane);
+			break;
+
+		case CHIP8_OP_8XY2:
+			REGISTER(lockstep, x, lane) &= REGISTER(lockstep, y, lane);
+			break;
+
+		case CHIP8_OP_8XY3:
+			REGISTER(lockstep, x, lane) ^= REGISTER(lockstep, y, lane);
+			break;
+
+		case CHIP8_OP_8XY4: {
+			uint16_t sum = REGISTER(lockstep, x, lane) + REGISTER(lockstep, y, lane);
+			REGISTER(lockstep, 0xf, lane) = sum > 0xffu;
+			REGISTER(lockstep, x, lane) = sum & 0x00ffu;
+			break;
+		}
+
+		case CHIP8_OP_8XY5:
+			REGISTER(lockstep, 0xf, lane) = REGISTER(lockstep, x, lane) > REGISTER(lockstep, y, lane);
+			REGISTER(lockstep, x, lane) -= REGISTER(lockstep, y, lane);
+			break;
+
+		case CHIP8_OP_8XY6:
+			REGISTER(lockstep, 0xf, lane) = REGISTER(lockstep, x, lane) & 0x01u;
+			REGISTER(lockstep, x, lane) >>= 1;
+			break;
+
+		case CHIP8_OP_8XY7:
+			REGISTER(lockstep, 0xf, lane) = REGISTER(lockstep, y, lane) > REGISTER(lockstep, x, lane);
+			REGISTER(lockstep, x, lane) = REGISTER(lockstep, y, lane) - REGISTER(lockstep, x, lane);
+			break;
+
+		case CHIP8_OP_8XYE:
+			REGISTER(lockstep, 0xf, lane) = REGISTER(lockstep, x, lane) >> 7u;
+			REGISTER(lockstep, x, lane) <<= 1;
+			break;
+
+		case CHIP8_OP_9XY0:
+			if (REGISTER(lockstep, x, lane) != REGISTER(lockstep, y, lane)) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_ANNN:
+			*index = nnn;
+			break;
+
+		case CHIP8_OP_BNNN:
+			*pc = REGISTER(lockstep, 0x0, lane) + nnn;
+			break;
+
+		case CHIP8_OP_CXKK:
+			REGISTER(lockstep, x, lane) = next_random_byte(&lockstep->random_state[lane]) & kk;
+			break;
+
+		case CHIP8_OP_DXYN: {
+			uint8_t x_start = REGISTER(lockstep, x, lane) % CHIP8_SCREEN_WIDTH;
+			uint8_t y_start = REGISTER(lockstep, y, lane) % CHIP8_SCREEN_HEIGHT;
+
+			REGISTER(lockstep, 0xf, lane) = 0x00;
+
+			for (uint8_t row = 0; row < (opcode & 0x000fu); row++) {
+				uint8_t screen_y = (y_start + row) % CHIP8_SCREEN_HEIGHT;
+				uint64_t sprite_row = (uint64_t) memory[(*index + row) & ADDRESS_MASK] << 56u;
+
+				if (x_start) {
+					sprite_row = (sprite_row >> x_start) | (sprite_row << (CHIP8_SCREEN_WIDTH - x_start));
+				}
+
+				if (video[screen_y] & sprite_row) {
+					REGISTER(lockstep, 0xf, lane) = 0x01;
+				}
+
+				if (sprite_row) {
+					video[screen_y] ^= sprite_row;
+					lockstep->dirty_rows[lane] |= 1u << screen_y;
+				}
+			}
+			break;
+		}
+
+		case CHIP8_OP_EX9E:
+			if (KEY(lockstep, REGISTER(lockstep, x, lane) % CHIP8_KEYPAD_SIZE, lane)) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_EXA1:
+			if (!KEY(lockstep, REGISTER(lockstep, x, lane) % CHIP8_KEYPAD_SIZE, lane)) {
+				*pc += 2;
+			}
+			break;
+
+		case CHIP8_OP_FX07:
+			update_lane_timers(lockstep, lane);
+			REGISTER(lockstep, x, lane) = lockstep->delay_timer[lane];
+			break;
+
+		case CHIP8_OP_FX0A: {
+			uint8_t key = 0;
+			while (key < CHIP8_KEYPAD_SIZE && !KEY(lockstep, key, lane)) {
+				key++;
+			}
+
+			if (key < CHIP8_KEYPAD_SIZE) {
+				REGISTER(lockstep, x, lane) = key;
+			} else {
+				*pc -= 2;
+			}
+			lockstep->waiting_for_key[lane] = key == CHIP8_KEYPAD_SIZE;
+			break;
+		}
+
+		case CHIP8_OP_FX15:
+			update_lane_timers(lockstep, lane);
+			lockstep->delay_timer[lane] = REGISTER(lockstep, x, lane);
+			break;
+
+		case CHIP8_OP_FX18:
+			update_lane_timers(lockstep, lane);
+			lockstep->sound_timer[lane] = REGISTER(lockstep, x, lane);
+			break;
+
+		case CHIP8_OP_FX1E:
+			*index += REGISTER(lockstep, x, lane);
+			break;
+
+		case CHIP8_OP_FX29:
+			*index = CHIP8_FONT_SET_START_ADDRESS + (5 * REGISTER(lockstep, x, lane));
+			break;
+
+		case CHIP8_OP_FX33: {
+			uint8_t value = REGISTER(lockstep, x, lane);
+			write_memory(lockstep, lane, *index + 2, value % 10);
+			write_memory(lockstep, lane, *index + 1, value / 10 % 10);
+			write_memory(lockstep, lane, *index, value / 100);
+			break;
+		}
+
+		case CHIP8_OP_FX55:
+			for (uint8_t i = 0; i <= x; i++) {
+				write_memory(lockstep, lane, *index + i, REGISTER(lockstep, i, lane));
+			}
+			break;
+
+		case CHIP8_OP_FX65:
+			for (uint8_t i = 0; i <= x; i++) {
+				REGISTER(lockstep, i, lane) = memory[(*index + i) & ADDRESS_MASK];
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+#ifdef __GNUC__
+typedef uint8_t LaneVector __attribute__((vector_size(CHIP8_LOCKSTEP_VECTOR_SIZE)));
+typedef int8_t LaneMask __attribute__((vector_size(CHIP8_LOCKSTEP_VECTOR_SIZE)));
+typedef uint16_t AddressVector __attribute__((vector_size(CHIP8_LOCKSTEP_VECTOR_SIZE * sizeof(uint16_t))));
+typedef int16_t AddressMask __attribute__((vector_size(CHIP8_LOCKSTEP_VECTOR_SIZE * sizeof(uint16_t))));
+
+#define LOAD_LANES(lanes) ({ \
+	LaneVector vector_; \
+	memcpy(&vector_, (lanes), sizeof(vector_)); \
+	vector_; \
+})
+
+// Only the lanes set in mask are written.
+#define STORE_LANES(lanes, vector, mask) do { \
+	LaneVector blended_ = ((vector) & (mask)) | (LOAD_LANES(lanes) & ~(mask)); \
+	memcpy((lanes), &blended_, sizeof(blended_)); \
+} while (0)
+
+#define LOAD_ADDRESSES(addresses) ({ \
+	AddressVector vector_; \
+	memcpy(&vector_, (addresses), sizeof(vector_)); \
+	vector_; \
+})
+
+#define STORE_ADDRESSES(addresses, vector, mask) do { \
+	AddressVector blended_ = ((vector) & (mask)) | (LOAD_ADDRESSES(addresses) & ~(mask)); \
+	memcpy((addresses), &blended_, sizeof(blended_)); \
+} while (0)
+
+// Widens a comparison or mask of bytes to one of 16-bit addresses.
+#define WIDEN_MASK(mask) ((AddressVector) __builtin_convertvector((LaneMask) (mask), AddressMask))
+
+// Execute a register, index or program counter instruction on the lanes of a
+// group set in mask, reading and writing registers in the same order as the
+// scalar handlers so that VF as an operand behaves the same. Returns 0 for
+// other instructions.
+static int execute_vector(Chip8Lockstep* lockstep, uint32_t group, uint16_t opcode, Chip8Op op, const LaneVector* lanes) {
+	uint8_t* vx = &REGISTER(lockstep, (opcode & 0x0f00u) >> 8u, group);
+	uint8_t* vy = &REGISTER(lockstep, (opcode & 0x00f0u) >> 4u, group);
+	uint8_t* vf = &REGISTER(lockstep, 0xf, group);
+	LaneVector kk = (LaneVector) {0} + (uint8_t) (opcode & 0x00ffu);
+	LaneVector mask = *lanes;
+	AddressVector address_mask = WIDEN_MASK(mask);
+	AddressVector nnn = (AddressVector) {0} + (uint16_t) (opcode & 0x0fffu);
+	uint16_t* pc = &lockstep->pc[group];
+	uint16_t* index = &lockstep->index[group];
+
+	switch (op) {
+		case CHIP8_OP_1NNN:
+			STORE_ADDRESSES(pc, nnn, address_mask);
+			return 1;
+
+		case CHIP8_OP_3XKK:
+			STORE_ADDRESSES(pc, LOAD_ADDRESSES(pc) + 2, address_mask & WIDEN_MASK(LOAD_LANES(vx) == kk));
+			return 1;
+
+		case CHIP8_OP_4XKK:
+			STORE_ADDRESSES(pc, LOAD_ADDRESSES(pc) + 2, address_mask & WIDEN_MASK(LOAD_LANES(vx) != kk));
+			return 1;
+
+		case CHIP8_OP_5XY0:
+			STORE_ADDRESSES(pc, LOAD_ADDRESSES(pc) + 2, address_mask & WIDEN_MASK(LOAD_LANES(vx) == LOAD_LANES(vy)));
+			return 1;
+
+		case CHIP8_OP_6XKK:
+			STORE_LANES(vx, kk, mask);
+			return 1;
+
+		case CHIP8_OP_7XKK:
+			STORE_LANES(vx, LOAD_LANES(vx) + kk, mask);
+			return 1;
+
+		case CHIP8_OP_8XY0:
+			STORE_LANES(vx, LOAD_LANES(vy), mask);
+			return 1;
+
+		case CHIP8_OP_8XY1:
+			STORE_LANES(vx, LOAD_LANES(vx) | LOAD_LANES(vy), mask);
+			return 1;
+
+		case CHIP8_OP_8XY2:
+			STORE_LANES(vx, LOAD_LANES(vx) & LOAD_LANES(vy), mask);
+			return 1;
+
+		case CHIP8_OP_8XY3:
+			STORE_LANES(vx, LOAD_LANES(vx) ^ LOAD_LANES(vy), mask);
+			return 1;
+
+		case CHIP8_OP_8XY4: {
+			LaneVector x = LOAD_LANES(vx);
+			LaneVector sum = x + LOAD_LANES(vy);
+			STORE_LANES(vf, (LaneVector) (sum < x) & 1, mask);
+			STORE_LANES(vx, sum, mask);
+			return 1;
+		}
+
+		case CHIP8_OP_8XY5:
+			STORE_LANES(vf, (LaneVector) (LOAD_LANES(vx) > LOAD_LANES(vy)) & 1, mask);
+			STORE_LANES(vx, LOAD_LANES(vx) - LOAD_LANES(vy), mask);
+			return 1;
+
+		case CHIP8_OP_8XY6:
+			STORE_LANES(vf, LOAD_LANES(vx) & 1, mask);
+			STORE_LANES(vx, LOAD_LANES(vx) >> 1, mask);
+			return 1;
+
+		case CHIP8_OP_8XY7:
+			STORE_LANES(vf, (LaneVector) (LOAD_LANES(vy) > LOAD_LANES(vx)) & 1, mask);
+			STORE_LANES(vx, LOAD_LANES(vy) - LOAD_LANES(vx), mask);
+			return 1;
+
+		case CHIP8_OP_8XYE:
+			STORE_LANES(vf, LOAD_LANES(vx) >> 7, mask);
+			STORE_LANES(vx, LOAD_LANES(vx) << 1, mask);
+			return 1;
+
+		case CHIP8_OP_9XY0:
+			STORE_ADDRESSES(pc, LOAD_ADDRESSES(pc) + 2, address_mask & WIDEN_MASK(LOAD_LANES(vx) != LOAD_LANES(vy)));
+			return 1;
+
+		case CHIP8_OP_ANNN:
+			STORE_ADDRESSES(index, nnn, address_mask);
+			return 1;
+
+		case CHIP8_OP_FX1E:
+			STORE_ADDRESSES(index, LOAD_ADDRESSES(index) + __builtin_convertvector(LOAD_LANES(vx), AddressVector), address_mask);
+			return 1;
+
+		case CHIP8_OP_FX29:
+			STORE_ADDRESSES(index, CHIP8_FONT_SET_START_ADDRESS + 5 * __builtin_convertvector(LOAD_LANES(vx), AddressVector), address_mask);
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+#endif
+
+static uint16_t fetch(Chip8Lockstep* lockstep, uint32_t lane, uint16_t pc) {
+	uint8_t* memory = MEMORY(lockstep, lane);
+	uint16_t address = pc & ADDRESS_MASK;
+
+	// The unused line after each memory makes the read past 0xfff safe, and
+	// the wrapped byte is patched in after.
+	uint16_t opcode = (memory[address] << 8u) | memory[address + 1];
+	if (address == ADDRESS_MASK) {
+		opcode = (opcode & 0xff00u) | memory[0];
+	}
+
+	return opcode;
+}
+
+#ifdef __GNUC__
+// Loading a vector from offset n keeps the last n lanes out of a group.
+static const uint16_t active_lanes[2 * CHIP8_LOCKSTEP_VECTOR_SIZE] = {
+	[0 ... CHIP8_LOCKSTEP_VECTOR_SIZE - 1] = 0xffff,
+};
+
+// Vector comparisons of 16-bit lanes are only cheap on some targets, so the
+// addresses are only combined with bitwise operations and tested whole.
+static int any_lane(const AddressVector* vector) {
+	uint64_t words[sizeof(*vector) / sizeof(uint64_t)];
+	uint64_t any = 0;
+
+	memcpy(words, vector, sizeof(*vector));
+	for (uint32_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+		any |= words[i];
+	}
+
+	return any != 0;
+}
+
+static void step_group(Chip8Lockstep* lockstep, uint32_t group) {
+	uint32_t lanes = lockstep->lane_count - group;
+	AddressVector active = LOAD_ADDRESSES(&active_lanes[CHIP8_LOCKSTEP_VECTOR_SIZE - (lanes < CHIP8_LOCKSTEP_VECTOR_SIZE ? lanes : CHIP8_LOCKSTEP_VECTOR_SIZE)]);
+	AddressVector pc = LOAD_ADDRESSES(&lockstep->pc[group]);
+	AddressVector opcodes;
+	int diverged = 0;
+
+	// When every lane is at the same address of code it shares with the
+	// first lane, one fetch serves the whole group.
+	uint16_t pages = PAGE_BIT(pc[0] & ADDRESS_MASK) | PAGE_BIT((pc[0] + 1) & ADDRESS_MASK);
+	AddressVector shared = LOAD_ADDRESSES(&lockstep->shared_pages[group]);
+	AddressVector differences = ((pc ^ pc[0]) | ((shared & pages) ^ pages)) & active;
+
+	if (any_lane(&differences)) {
+		uint16_t fetched[CHIP8_LOCKSTEP_VECTOR_SIZE] = {0};
+		for (uint32_t i = 0; i < lanes && i < CHIP8_LOCKSTEP_VECTOR_SIZE; i++) {
+			fetched[i] = fetch(lockstep, group + i, lockstep->pc[group + i]);
+		}
+		opcodes = LOAD_ADDRESSES(fetched);
+
+		differences = (opcodes ^ opcodes[0]) & active;
+		diverged = any_lane(&differences);
+	} else {
+		opcodes = (AddressVector) {0} + fetch(lockstep, group, pc[0]);
+	}
+
+	STORE_ADDRESSES(&lockstep->pc[group], pc + 2, active);
+	// fx0a writes the opcode, so the fetched ones are kept apart.
+	STORE_ADDRESSES(&lockstep->opcode[group], opcodes, active);
+
+	LaneVector mask = (LaneVector) __builtin_convertvector((AddressMask) active, LaneMask);
+	if (diverged) {
+		for (uint32_t i = 0; i < CHIP8_LOCKSTEP_VECTOR_SIZE; i++) {
+			mask[i] &= opcodes[i] == opcodes[0] ? 0xff : 0x00;
+		}
+	}
+
+	Chip8Op op = identify(opcodes[0]);
+
+	if (execute_vector(lockstep, group, opcodes[0], op, &mask)) {
+		if (!diverged) {
+			return;
+		}
+	} else {
+		mask = (LaneVector) {0};
+	}
+
+	for (uint32_t i = 0; i < CHIP8_LOCKSTEP_VECTOR_SIZE; i++) {
+		if (active[i] && !mask[i]) {
+			execute_lane(lockstep, group + i, opcodes[i], diverged ? identify(opcodes[i]) : op);
+		}
+	}
+}
+#else
+static void step_group(Chip8Lockstep* lockstep, uint32_t group) {
+	uint32_t active = lockstep->lane_count - group;
+	uint16_t opcodes[CHIP8_LOCKSTEP_VECTOR_SIZE];
+
+	if (active > CHIP8_LOCKSTEP_VECTOR_SIZE) {
+		active = CHIP8_LOCKSTEP_VECTOR_SIZE;
+	}
+
+	for (uint32_t i = 0; i < active; i++) {
+		opcodes[i] = fetch(lockstep, group + i, lockstep->pc[group + i]);
+		lockstep->pc[group + i] += 2;
+		lockstep->opcode[group + i] = opcodes[i];
+	}
+
+	for (uint32_t i = 0; i < active; i++) {
+		execute_lane(lockstep, group + i, opcodes[i], identify(opcodes[i]));
+	}
+}
+#endif
+
+void run_lockstep(Chip8Lockstep* lockstep, uint32_t count) {
+	// Lanes never affect each other, so each group runs all of its steps at
+	// once while its state is still in cache.
+	for (uint32_t group = 0; group < lockstep->lane_count; group += CHIP8_LOCKSTEP_VECTOR_SIZE) {
+		uint32_t lanes = lockstep->lane_count - group;
+
+		if (lanes > CHIP8_LOCKSTEP_VECTOR_SIZE) {
+			lanes = CHIP8_LOCKSTEP_VECTOR_SIZE;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			step_group(lockstep, group);
+
+			for (uint32_t lane = group; lane < group + lanes; lane++) {
+				lockstep->instruction_count[lane]++;
+			}
+		}
+	}
+
+	for (uint32_t lane = 0; lane < lockstep->lane_count; lane++) {
+		update_lane_timers(lockstep, lane);
+	}
+}
+
+void lockstep_destroy(Chip8Lockstep* lockstep) {
+	if (!lockstep) {
+		return;
+	}
+
+	free(lockstep->registers);
+	free(lockstep->keypad);
+	free(lockstep->waiting_for_key);
+	free(lockstep->memory);
+	free(lockstep->stack);
+	free(lockstep->video);
+	free(lockstep->index);
+	free(lockstep->pc);
+	free(lockstep->opcode);
+	free(lockstep->sp);
+	free(lockstep->delay_timer);
+	free(lockstep->sound_timer);
+	free(lockstep->dirty_rows);
+	free(lockstep->instruction_count);
+	free(lockstep->timers_updated_at);
+	free(lockstep->instructions_per_tick);
+	free(lockstep->random_state);
+	free(lockstep->shared_pages);
+	free(lockstep);
+}
@@ -1,50 +1,276 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
 #include <time.h>
+#include <unistd.h>
 #include "../inc/instructions.h"
+#include "../inc/frames.h"
 #include "../inc/platform.h"
+#include "../inc/aot.h"
+#include "../inc/movie.h"
+#include "../inc/rewind.h"
+#include "../inc/state.h"
 
 #define NUMBER_OF_ARGUMENTS 4
+#define NUMBER_OF_SNAPSHOT_ARGUMENTS 2
 #define TITLE "My Cute Chip8 Emulator"
+#define FRAMES_PER_SECOND 60
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define NANOSECONDS_PER_FRAME (NANOSECONDS_PER_SECOND / FRAMES_PER_SECOND)
+// About a minute of frames for most ROMs.
+#define DEFAULT_REWIND_KILOBYTES 1024
+
+static void add_nanoseconds(struct timespec* time, long nanoseconds) {
+	time->tv_nsec += nanoseconds;
+
+	while (time->tv_nsec >= NANOSECONDS_PER_SECOND) {
+		time->tv_nsec -= NANOSECONDS_PER_SECOND;
+		time->tv_sec++;
+	}
+}
+
+static int is_before(struct timespec* a, struct timespec* b) {
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// Parse a whole decimal number from minimum to maximum, or return -1.
+static int parse_number(const char* text, long minimum, long maximum, long* value) {
+	char* end;
+	errno = 0;
+	*value = strtol(text, &end, 10);
+
+	return errno || end == text || *end || *value < minimum || *value > maximum ? -1 : 0;
+}
+
+static void usage(char* name) {
+	printf("Usage: %s [-r movie to record | -p movie to play] [-b rewind kilobytes] [-w snapshot to write on exit] <scale> <instructions per frame> <rom> [recompiled rom]\n", name);
+	printf("       %s -s snapshot to start from [-b rewind kilobytes] [-w snapshot to write on exit] <scale> <instructions per frame>\n", name);
+}
 
 int main(int argc, char** argv) {
-	if (argc != NUMBER_OF_ARGUMENTS) {
+	char* record_file = NULL;
+	char* snapshot_file = NULL;
+	char* write_file = NULL;
+	Chip8Movie* movie = NULL;
+	long rewind_kilobytes = DEFAULT_REWIND_KILOBYTES;
+
+	int option;
+	while ((option = getopt(argc, argv, "r:p:b:s:w:")) != -1) {
+		switch (option) {
+			case 'r':
+				record_file = optarg;
+				break;
+			case 'p':
+				movie = load_movie(optarg);
+				if (!movie) {
+					printf("Could not load %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'b':
+				// 0 turns rewinding off.
+				if (parse_number(optarg, 0, LONG_MAX / 1024, &rewind_kilobytes)) {
+					printf("The rewind kilobytes must be from 0 to %ld\n", LONG_MAX / 1024);
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				snapshot_file = optarg;
+				break;
+			case 'w':
+				write_file = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (record_file && movie) {
+		printf("Cannot record and play a movie at the same time.\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	// A movie starts from the ROM, so it cannot be recorded or played from a
+	// snapshot.
+	if (snapshot_file && (record_file || movie)) {
+		printf("Cannot start from a snapshot while recording or playing a movie.\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	int arguments = argc - optind;
+	int expected = snapshot_file ? NUMBER_OF_SNAPSHOT_ARGUMENTS : NUMBER_OF_ARGUMENTS - 1;
+	if (arguments != expected && (snapshot_file || arguments != NUMBER_OF_ARGUMENTS)) {
 		printf("Wrong number of arguments.\n");
-		printf("Expected %d, but got %d\n", NUMBER_OF_ARGUMENTS, argc - 1);
-		printf("Usage: %s <scale> <delay> <rom>\n", argv[0]);
+		printf("Expected %d, but got %d\n", expected, arguments);
+		usage(argv[0]);
 		return 1;
 	}
 
+	long video_scale;
+	long instructions_per_frame;
+	if (parse_number(argv[optind], 1, UINT16_MAX, &video_scale)
+			|| parse_number(argv[optind + 1], 1, UINT16_MAX, &instructions_per_frame)) {
+		printf("The scale and instructions per frame must be from 1 to %d\n", UINT16_MAX);
+		usage(argv[0]);
+		return 1;
+	}
 
-	int video_scale = atoi(argv[1]);
-	int cycle_delay = atoi(argv[2]);
-	char* rom_file = argv[3];
+	Chip8* chip;
+	if (snapshot_file) {
+		Chip8Error error = chip8_map_state_file(&chip, snapshot_file);
+		if (error) {
+			printf("Could not load %s: %s\n", snapshot_file, chip8_strerror(error));
+			return 1;
+		}
+	} else {
+		char* rom_file = argv[optind + 2];
 
-	platform_create(TITLE, CHIP8_SCREEN_WIDTH * video_scale, CHIP8_SCREEN_HEIGHT * video_scale, CHIP8_SCREEN_WIDTH, CHIP8_SCREEN_HEIGHT);
+		chip = create();
+		if (!chip) {
+			printf("%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+			return 1;
+		}
 
-	Chip8* chip = create();
-	load_rom(chip, rom_file);
+		Chip8Error error = load_rom(chip, rom_file);
+		if (error) {
+			printf("Could not load %s: %s\n", rom_file, chip8_strerror(error));
+			return 1;
+		}
+	}
 
-	int video_pitch = sizeof(chip->video[0]) * CHIP8_SCREEN_WIDTH;
+	// A recording needs a seed it knows, and a movie replays with the seed
+	// and the timer rate it was recorded with.
+	if (record_file) {
+		uint64_t seed;
+		if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+			seed = (uint64_t) time(NULL);
+		}
+		seed_random(chip, seed);
+		movie = create_movie(seed, instructions_per_frame);
+	} else if (movie) {
+		seed_random(chip, movie->seed);
+		instructions_per_frame = movie->instructions_per_tick;
+	}
+	chip->instructions_per_tick = instructions_per_frame;
+
+	if (arguments == NUMBER_OF_ARGUMENTS) {
+		if (load_aot(chip, argv[optind + 3])) {
+			printf("Could not load %s\n", argv[optind + 3]);
+			return 1;
+		}
+		chip->engine = CHIP8_ENGINE_AOT;
+	}
+
+	// Going back in time would leave a movie out of step with the chip.
+	Chip8Rewind* history = NULL;
+	if (rewind_kilobytes && !movie) {
+		history = create_rewind(rewind_kilobytes * 1024);
+		if (!history) {
+			printf("%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+			return 1;
+		}
+		rewind_push(history, chip);
+	}
 
-	clock_t last_cycle_time = clock();
+	static Chip8Frames frames;
+	frames_init(&frames);
+
+	Platform* platform = platform_create(TITLE, CHIP8_SCREEN_WIDTH * video_scale, CHIP8_SCREEN_HEIGHT * video_scale, &frames);
+	if (!platform) {
+		printf("Could not create the window: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	struct timespec next_frame;
+	clock_gettime(CLOCK_MONOTONIC, &next_frame);
 	int quit = 0;
+	uint32_t frame = 0;
+	size_t event = 0;
 
-	while(!quit) {
-		quit = platform_process_input(chip->keypad);
+	while (!quit) {
+		// Nothing happens while fx0a waits for a key and no timer is counting
+		// down, so block until the next event. A movie being played has the
+		// next key itself.
+		if (record_file || !movie) {
+			if (chip->waiting_for_key && !chip->delay_timer && !chip->sound_timer && !platform->rewinding) {
+				quit = platform_wait_input(platform, chip->keypad);
+			} else {
+				quit = platform_process_input(platform, chip->keypad);
+			}
+		} else {
+			uint8_t keypad[CHIP8_KEYPAD_SIZE] = { 0 };
+			quit = platform_process_input(platform, keypad);
+			while (event < movie->event_count && movie->events[event].instruction <= chip->instruction_count) {
+				movie_apply(&movie->events[event++], chip);
+			}
+		}
 
-		clock_t current_time = clock();
-		int dt = (current_time - last_cycle_time) * 1000 / CLOCKS_PER_SEC;
+		if (record_file && movie_record(movie, chip, frame)) {
+			printf("Could not record input\n");
+			quit = 1;
+		}
 
-		if (dt > cycle_delay) {
-			last_cycle_time = current_time;
-			cycle(chip);
-			platform_update(chip->video, video_pitch);
+		if (history && platform->rewinding) {
+			// The keys held now stay held in the frame gone back to.
+			uint8_t keypad[CHIP8_KEYPAD_SIZE];
+			memcpy(keypad, chip->keypad, sizeof(keypad));
+			if (!rewind_pop(history, chip)) {
+				chip->dirty_rows = 0xffffffff;
+			}
+			memcpy(chip->keypad, keypad, sizeof(keypad));
+		} else {
+			run(chip, instructions_per_frame);
+			frame++;
 		}
+
+		if (chip->dirty_rows) {
+			publish_video(&frames, chip);
+			platform_update(platform);
+		}
+
+		if (history && !platform->rewinding) {
+			rewind_push(history, chip);
+		}
+
+		add_nanoseconds(&next_frame, NANOSECONDS_PER_FRAME);
+
+		// After a stall, start counting frames from now instead of running
+		// every missed frame back to back.
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (is_before(&next_frame, &now)) {
+			next_frame = now;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_frame, NULL);
 	}
 
-	destroy(chip);
-	platform_destroy();
+	if (record_file && save_movie(movie, record_file)) {
+		printf("Could not save %s\n", record_file);
+	}
+	movie_destroy(movie);
+	rewind_destroy(history);
+
+	if (write_file) {
+		Chip8Error error = chip8_save_state_file(chip, write_file);
+		if (error) {
+			printf("Could not save %s: %s\n", write_file, chip8_strerror(error));
+		}
+	}
+
+	if (snapshot_file) {
+		chip8_unmap_state_file(chip);
+	} else {
+		destroy(chip);
+	}
+	platform_destroy(platform);
 
 	return 0;
 }
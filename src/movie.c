@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/movie.h"
+
+#define CHIP8_MOVIE_MAGIC "C8MV"
+#define CHIP8_MOVIE_MAGIC_SIZE 4
+// Written by the platform for a pressed key, so that a replayed keypad is the
+// recorded one byte for byte.
+#define CHIP8_MOVIE_KEY_PRESSED 0xff
+
+Chip8Movie* create_movie(uint64_t seed, uint16_t instructions_per_tick) {
+	Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+
+	if (movie) {
+		movie->seed = seed;
+		movie->instructions_per_tick = instructions_per_tick;
+	}
+
+	return movie;
+}
+
+int movie_add(Chip8Movie* movie, Chip8MovieEvent event) {
+	if (movie->event_count) {
+		const Chip8MovieEvent* last = &movie->events[movie->event_count - 1];
+		if (event.instruction < last->instruction || event.frame < last->frame) {
+			return -1;
+		}
+	}
+
+	if (movie->event_count == movie->event_capacity) {
+		size_t capacity = movie->event_capacity ? movie->event_capacity * 2 : 64;
+		Chip8MovieEvent* events = realloc(movie->events, capacity * sizeof(Chip8MovieEvent));
+		if (!events) {
+			return -1;
+		}
+		movie->events = events;
+		movie->event_capacity = capacity;
+	}
+
+	movie->events[movie->event_count++] = event;
+
+	return 0;
+}
+
+static uint16_t pressed_keys(Chip8* chip) {
+	uint16_t keys = 0;
+
+	for (int key = 0; key < CHIP8_KEYPAD_SIZE; key++) {
+		if (chip->keypad[key]) {
+			keys |= 1u << key;
+		}
+	}
+
+	return keys;
+}
+
+int movie_record(Chip8Movie* movie, Chip8* chip, uint32_t frame) {
+	uint16_t keys = pressed_keys(chip);
+	uint16_t last = movie->event_count ? movie->events[movie->event_count - 1].keys : 0;
+
+	if (keys == last) {
+		return 0;
+	}
+
+	return movie_add(movie, (Chip8MovieEvent){ chip->instruction_count, frame, keys });
+}
+
+void movie_apply(const Chip8MovieEvent* event, Chip8* chip) {
+	for (int key = 0; key < CHIP8_KEYPAD_SIZE; key++) {
+		chip->keypad[key] = (event->keys >> key) & 1 ? CHIP8_MOVIE_KEY_PRESSED : 0;
+	}
+}
+
+static void write_bytes(FILE* f, uint64_t value, int size) {
+	for (int i = 0; i < size; i++) {
+		fputc((value >> (8 * i)) & 0xff, f);
+	}
+}
+
+static int read_bytes(FILE* f, uint64_t* value, int size) {
+	*value = 0;
+
+	for (int i = 0; i < size; i++) {
+		int byte = fgetc(f);
+		if (byte == EOF) {
+			return -1;
+		}
+		*value |= (uint64_t)byte << (8 * i);
+	}
+
+	return 0;
+}
+
+static void write_varint(FILE* f, uint64_t value) {
+	while (value >= 0x80) {
+		fputc((value & 0x7f) | 0x80, f);
+		value >>= 7;
+	}
+	fputc(value, f);
+}
+
+static int read_varint(FILE* f, uint64_t* value) {
+	*value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		int byte = fgetc(f);
+		if (byte == EOF) {
+			return -1;
+		}
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int save_movie(const Chip8Movie* movie, const char* path) {
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		return -1;
+	}
+
+	fwrite(CHIP8_MOVIE_MAGIC, 1, CHIP8_MOVIE_MAGIC_SIZE, f);
+	write_bytes(f, CHIP8_MOVIE_VERSION, 1);
+	write_bytes(f, movie->instructions_per_tick, 2);
+	write_bytes(f, movie->seed, 8);
+	write_bytes(f, movie->event_count, 4);
+
+	Chip8MovieEvent last = { 0 };
+	for (size_t i = 0; i < movie->event_count; i++) {
+		const Chip8MovieEvent* event = &movie->events[i];
+		write_varint(f, event->instruction - last.instruction);
+		write_varint(f, event->frame - last.frame);
+		write_bytes(f, event->keys, 2);
+		last = *event;
+	}
+
+	int failed = ferror(f);
+
+	return fclose(f) || failed ? -1 : 0;
+}
+
+static int read_events(FILE* f, Chip8Movie* movie, uint64_t event_count) {
+	Chip8MovieEvent event = { 0 };
+
+	for (uint64_t i = 0; i < event_count; i++) {
+		uint64_t instructions, frames, keys;
+		if (read_varint(f, &instructions) || read_varint(f, &frames) || read_bytes(f, &keys, 2)
+				|| frames > UINT32_MAX - event.frame) {
+			return -1;
+		}
+
+		event.instruction += instructions;
+		event.frame += frames;
+		event.keys = keys;
+		if (movie_add(movie, event)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+Chip8Movie* load_movie(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		return NULL;
+	}
+
+	char magic[CHIP8_MOVIE_MAGIC_SIZE];
+	uint64_t version, instructions_per_tick, seed, event_count;
+	if (fread(magic, 1, CHIP8_MOVIE_MAGIC_SIZE, f) != CHIP8_MOVIE_MAGIC_SIZE
+			|| memcmp(magic, CHIP8_MOVIE_MAGIC, CHIP8_MOVIE_MAGIC_SIZE)
+			|| read_bytes(f, &version, 1) || version != CHIP8_MOVIE_VERSION
+			|| read_bytes(f, &instructions_per_tick, 2) || !instructions_per_tick || read_bytes(f, &seed, 8)
+			|| read_bytes(f, &event_count, 4)) {
+		fclose(f);
+		return NULL;
+	}
+
+	Chip8Movie* movie = create_movie(seed, instructions_per_tick);
+	if (!movie || read_events(f, movie, event_count) || fgetc(f) != EOF) {
+		movie_destroy(movie);
+		movie = NULL;
+	}
+	fclose(f);
+
+	return movie;
+}
+
+void movie_destroy(Chip8Movie* movie) {
+	if (!movie) {
+		return;
+	}
+
+	free(movie->events);
+	free(movie);
+}
@@ -1,31 +1,142 @@
+#include <stdlib.h>
 #include "../inc/platform.h"
 
-SDL_Window* platform_window = NULL;
-SDL_Renderer* platform_renderer = NULL;
-SDL_Texture* platform_texture = NULL;
+static void upload(Platform* platform, Chip8Frame* frame) {
+	int pitch = CHIP8_SCREEN_WIDTH * sizeof(frame->pixels[0]);
+	int rows = CHIP8_SCREEN_HEIGHT;
 
-void platform_create(char* title, int window_width, int window_height, int texture_width, int texture_height) {
-	SDL_Init(SDL_INIT_VIDEO);
-	platform_window = SDL_CreateWindow(title, 0, 0, window_width, window_height, SDL_WINDOW_SHOWN);
-	platform_renderer = SDL_CreateRenderer(platform_window, -1, SDL_RENDERER_ACCELERATED);
-	platform_texture = SDL_CreateTexture(platform_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, texture_width, texture_height);
+	// Upload each run of consecutive dirty rows with a single call.
+	for (int row = 0; row < rows; row++) {
+		if (!((frame->dirty_rows >> row) & 0x1u)) {
+			continue;
+		}
+
+		int first = row;
+		while (row + 1 < rows && ((frame->dirty_rows >> (row + 1)) & 0x1u)) {
+			row++;
+		}
+
+		SDL_Rect rect = { 0, first, CHIP8_SCREEN_WIDTH, row - first + 1 };
+		SDL_UpdateTexture(platform->texture, &rect, &frame->pixels[first * CHIP8_SCREEN_WIDTH], pitch);
+	}
+}
+
+/*
+ * Draw the newest frame every time one is published. The renderer lives and
+ * dies on this thread, so presenting and waiting for vsync never hold up the
+ * emulation.
+ *
+ * SDL only promises rendering on the thread that created the window. X11
+ * and Wayland with the OpenGL, OpenGL ES and software renderers, and Windows
+ * with Direct3D, allow a renderer on another thread. Cocoa on macOS does not.
+ * A renderer that cannot be created is reported to platform_create() before
+ * any frame is drawn.
+ */
+static int render(void* data) {
+	Platform* platform = data;
+
+	platform->renderer = SDL_CreateRenderer(platform->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (platform->renderer) {
+		platform->texture = SDL_CreateTexture(platform->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, CHIP8_SCREEN_WIDTH, CHIP8_SCREEN_HEIGHT);
+	}
+
+	platform->render_failed = !platform->texture;
+	SDL_SemPost(platform->render_started);
+
+	if (platform->render_failed) {
+		if (platform->renderer) {
+			SDL_DestroyRenderer(platform->renderer);
+		}
+		return -1;
+	}
+
+	for (;;) {
+		SDL_SemWait(platform->frame_ready);
+
+		if (atomic_load(&platform->quit)) {
+			break;
+		}
+
+		Chip8Frame* frame = frames_take(platform->frames);
+		if (!frame) {
+			continue;
+		}
+
+		upload(platform, frame);
+
+		SDL_RenderClear(platform->renderer);
+		SDL_RenderCopy(platform->renderer, platform->texture, NULL, NULL);
+		SDL_RenderPresent(platform->renderer);
+	}
+
+	SDL_DestroyTexture(platform->texture);
+	SDL_DestroyRenderer(platform->renderer);
+
+	return 0;
+}
+
+// SDL counts how many times the video subsystem was initialized, so every
+// platform can hold it for as long as it lives. Returns NULL if the window,
+// its render thread or the renderer of that thread could not be created.
+Platform* platform_create(char* title, int window_width, int window_height, Chip8Frames* frames) {
+	Platform* platform = calloc(1, sizeof(Platform));
+	if (!platform) {
+		return NULL;
+	}
+
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+		free(platform);
+		return NULL;
+	}
+
+	platform->window = SDL_CreateWindow(title, 0, 0, window_width, window_height, SDL_WINDOW_SHOWN);
+	platform->frames = frames;
+	platform->frame_ready = SDL_CreateSemaphore(0);
+	platform->render_started = SDL_CreateSemaphore(0);
+	atomic_init(&platform->quit, 0);
+
+	if (platform->window && platform->frame_ready && platform->render_started) {
+		platform->render_thread = SDL_CreateThread(render, "render", platform);
+	}
+
+	if (platform->render_thread) {
+		SDL_SemWait(platform->render_started);
+		if (platform->render_failed) {
+			SDL_WaitThread(platform->render_thread, NULL);
+			platform->render_thread = NULL;
+		}
+	}
+
+	if (!platform->render_thread) {
+		SDL_DestroySemaphore(platform->render_started);
+		SDL_DestroySemaphore(platform->frame_ready);
+		SDL_DestroyWindow(platform->window);
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+		free(platform);
+		return NULL;
+	}
+
+	return platform;
 }
 
-void platform_destroy(void) {
-	SDL_DestroyTexture(platform_texture);
-	SDL_DestroyRenderer(platform_renderer);
-	SDL_DestroyWindow(platform_window);
-	SDL_Quit();
+void platform_destroy(Platform* platform) {
+	atomic_store(&platform->quit, 1);
+	SDL_SemPost(platform->frame_ready);
+	SDL_WaitThread(platform->render_thread, NULL);
+
+	SDL_DestroySemaphore(platform->render_started);
+	SDL_DestroySemaphore(platform->frame_ready);
+	SDL_DestroyWindow(platform->window);
+	SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	free(platform);
 }
 
-void platform_update(uint32_t* video, int pitch) {
-	SDL_UpdateTexture(platform_texture, NULL, video, pitch);
-	SDL_RenderClear(platform_renderer);
-	SDL_RenderCopy(platform_renderer, platform_texture, NULL, NULL);
-	SDL_RenderPresent(platform_renderer);
+// Tell the render thread a frame was published. It never waits.
+void platform_update(Platform* platform) {
+	SDL_SemPost(platform->frame_ready);
 }
 
-int platform_process_input(uint8_t* keypad) {
+int platform_process_input(Platform* platform, uint8_t* keypad) {
 	int quit = 0;
 
 	SDL_Event event;
@@ -44,6 +155,11 @@ int platform_process_input(uint8_t* keypad) {
 					}
 						break;
 
+					case SDLK_BACKSPACE: {
+						platform->rewinding = 1;
+					}
+						break;
+
 					case SDLK_x: {
 						keypad[0x0] = 0xff;
 					}
@@ -129,6 +245,11 @@ int platform_process_input(uint8_t* keypad) {
 
 			case SDL_KEYUP: {
 				switch (event.key.keysym.sym) {
+					case SDLK_BACKSPACE: {
+						platform->rewinding = 0;
+					}
+						break;
+
 					case SDLK_x: {
 						keypad[0x0] = 0x00;
 					}
@@ -217,3 +338,10 @@ int platform_process_input(uint8_t* keypad) {
 	return quit;
 
 }
+
+// Sleep until the next event instead of polling for it every frame.
+int platform_wait_input(Platform* platform, uint8_t* keypad) {
+	SDL_WaitEvent(NULL);
+
+	return platform_process_input(platform, keypad);
+}
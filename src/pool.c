@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "../inc/pool.h"
+#include "../inc/jit.h"
+#include "../inc/aot.h"
+
+#define CACHE_LINE_SIZE 64
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+static void* map_arena(size_t size, int flags) {
+#ifdef MAP_HUGETLB
+	if (flags & CHIP8_POOL_HUGEPAGES) {
+		void* arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (arena != MAP_FAILED) {
+			return arena;
+		}
+	}
+#endif
+
+	void* arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (arena == MAP_FAILED) {
+		return NULL;
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (flags & CHIP8_POOL_HUGEPAGES) {
+		madvise(arena, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	return arena;
+}
+
+Chip8Pool* create_pool(uint32_t capacity, int flags) {
+	Chip8Pool* pool = calloc(1, sizeof(Chip8Pool));
+
+	if (!pool) {
+		return NULL;
+	}
+
+	pool->capacity = capacity;
+	pool->stride = (sizeof(Chip8) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+	pool->arena_size = pool->stride * (capacity ? capacity : 1);
+	// Explicit hugepages can only be mapped whole.
+	if (flags & CHIP8_POOL_HUGEPAGES) {
+		pool->arena_size = (pool->arena_size + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE * HUGEPAGE_SIZE;
+	}
+
+	pool->arena = map_arena(pool->arena_size, flags);
+	pool->free_slots = malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+
+	if (!pool->arena || !pool->free_slots) {
+		pool_destroy(pool);
+		return NULL;
+	}
+
+	// Hand out the start of the arena first, so a pool that is larger than
+	// needed only ever touches its first pages.
+	for (uint32_t i = 0; i < capacity; i++) {
+		pool->free_slots[i] = capacity - 1 - i;
+	}
+	pool->free_count = capacity;
+
+	return pool;
+}
+
+Chip8* pool_acquire(Chip8Pool* pool, const Chip8* pristine) {
+	if (!pool->free_count) {
+		return NULL;
+	}
+
+	// The arena starts zeroed, which is a valid chip with nothing decoded.
+	Chip8* chip = (Chip8*) &pool->arena[pool->free_slots[--pool->free_count] * pool->stride];
+	chip8_reset(chip, pristine);
+
+	return chip;
+}
+
+void pool_release(Chip8Pool* pool, Chip8* chip) {
+	pool->free_slots[pool->free_count++] = ((uint8_t*) chip - pool->arena) / pool->stride;
+}
+
+void pool_destroy(Chip8Pool* pool) {
+	if (!pool) {
+		return;
+	}
+
+	if (pool->arena) {
+		for (uint32_t i = 0; i < pool->capacity; i++) {
+			Chip8* chip = (Chip8*) &pool->arena[i * pool->stride];
+			jit_destroy(chip->jit);
+			aot_destroy(chip->aot);
+		}
+		munmap(pool->arena, pool->arena_size);
+	}
+
+	free(pool->free_slots);
+	free(pool);
+}
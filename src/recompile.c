@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/chip8.h"
+
+#define NUMBER_OF_ARGUMENTS 3
+
+#define HANDLER_NAME(OP, handler, mask, pattern, syntax) [CHIP8_OP_##OP] = #handler,
+
+static const char* handler_names[CHIP8_OP_COUNT] = {
+	CHIP8_ISA(HANDLER_NAME)
+};
+
+static uint8_t is_block[CHIP8_MEMORY_SIZE];
+static uint16_t pending[CHIP8_MEMORY_SIZE];
+static uint16_t pending_count = 0;
+
+static int fits_in_page(uint16_t address, uint16_t page) {
+	return (uint32_t) address + 1 < CHIP8_MEMORY_SIZE && (address + 1) / CHIP8_PAGE_SIZE == page;
+}
+
+static void add_block(uint16_t address) {
+	if (!fits_in_page(address, address / CHIP8_PAGE_SIZE) || is_block[address]) {
+		return;
+	}
+
+	is_block[address] = 1;
+	pending[pending_count++] = address;
+}
+
+/*
+ * Walk the block starting at address and queue the blocks it can continue
+ * to. Returns the number of instructions in the block.
+ */
+static uint16_t walk_block(Chip8* chip, uint16_t address) {
+	uint16_t page = address / CHIP8_PAGE_SIZE;
+	uint16_t length = 0;
+	Chip8Instruction instruction;
+
+	while (fits_in_page(address, page)) {
+		decode(chip, address, &instruction);
+		address += 2;
+		length++;
+
+		if (ends_block(instruction.op)) {
+			break;
+		}
+	}
+
+	switch (instruction.op) {
+		case CHIP8_OP_1NNN:
+			add_block(instruction.nnn);
+			break;
+
+		case CHIP8_OP_2NNN:
+			add_block(instruction.nnn);
+			add_block(address);
+			break;
+
+		case CHIP8_OP_3XKK:
+		case CHIP8_OP_4XKK:
+		case CHIP8_OP_5XY0:
+		case CHIP8_OP_9XY0:
+		case CHIP8_OP_EX9E:
+		case CHIP8_OP_EXA1:
+			add_block(address);
+			add_block(address + 2);
+			break;
+
+		case CHIP8_OP_00EE:
+		case CHIP8_OP_BNNN:
+			break;
+
+		default:
+			add_block(address);
+			break;
+	}
+
+	return length;
+}
+
+static void flush_instruction_count(FILE* out, uint16_t* instructions) {
+	if (*instructions) {
+		fprintf(out, "\tchip->instruction_count += %u;\n", *instructions);
+		*instructions = 0;
+	}
+}
+
+/*
+ * Emit the C version of an instruction, keeping the exact order of reads and
+ * writes of the op_* handler. Returns 0 when the handler has to be called, in
+ * which case the instruction count is brought up to date first, as it is
+ * before the timers are read or set.
+ */
+static int emit_inline(FILE* out, Chip8Instruction* i, uint16_t* instructions) {
+	switch (i->op) {
+		case CHIP8_OP_NULL:
+			return 1;
+		case CHIP8_OP_1NNN:
+			fprintf(out, "\tchip->pc = 0x%04x;\n", i->nnn);
+			return 1;
+		case CHIP8_OP_6XKK:
+			fprintf(out, "\tv[0x%x] = 0x%02x;\n", i->x, i->kk);
+			return 1;
+		case CHIP8_OP_7XKK:
+			fprintf(out, "\tv[0x%x] += 0x%02x;\n", i->x, i->kk);
+			return 1;
+		case CHIP8_OP_8XY0:
+			fprintf(out, "\tv[0x%x] = v[0x%x];\n", i->x, i->y);
+			return 1;
+		case CHIP8_OP_8XY1:
+			fprintf(out, "\tv[0x%x] |= v[0x%x];\n", i->x, i->y);
+			return 1;
+		case CHIP8_OP_8XY2:
+			fprintf(out, "\tv[0x%x] &= v[0x%x];\n", i->x, i->y);
+			return 1;
+		case CHIP8_OP_8XY3:
+			fprintf(out, "\tv[0x%x] ^= v[0x%x];\n", i->x, i->y);
+			return 1;
+		case CHIP8_OP_8XY4:
+			fprintf(out, "\tsum = v[0x%x] + v[0x%x];\n", i->x, i->y);
+			fprintf(out, "\tv[0xf] = sum > 0xffu;\n");
+			fprintf(out, "\tv[0x%x] = sum & 0x00ffu;\n", i->x);
+			return 1;
+		case CHIP8_OP_8XY5:
+			fprintf(out, "\tv[0xf] = v[0x%x] > v[0x%x];\n", i->x, i->y);
+			fprintf(out, "\tv[0x%x] -= v[0x%x];\n", i->x, i->y);
+			return 1;
+		case CHIP8_OP_8XY6:
+			fprintf(out, "\tv[0xf] = v[0x%x] & 0x01u;\n", i->x);
+			fprintf(out, "\tv[0x%x] >>= 1;\n", i->x);
+			return 1;
+		case CHIP8_OP_8XY7:
+			fprintf(out, "\tv[0xf] = v[0x%x] > v[0x%x];\n", i->y, i->x);
+			fprintf(out, "\tv[0x%x] = v[0x%x] - v[0x%x];\n", i->x, i->y, i->x);
+			return 1;
+		case CHIP8_OP_8XYE:
+			fprintf(out, "\tv[0xf] = v[0x%x] >> 7u;\n", i->x);
+			fprintf(out, "\tv[0x%x] <<= 1;\n", i->x);
+			return 1;
+		case CHIP8_OP_ANNN:
+			fprintf(out, "\tchip->index = 0x%04x;\n", i->nnn);
+			return 1;
+		case CHIP8_OP_FX07:
+			flush_instruction_count(out, instructions);
+			fprintf(out, "\tupdate_timers(chip);\n");
+			fprintf(out, "\tv[0x%x] = chip->delay_timer;\n", i->x);
+			return 1;
+		case CHIP8_OP_FX15:
+			flush_instruction_count(out, instructions);
+			fprintf(out, "\tupdate_timers(chip);\n");
+			fprintf(out, "\tchip->delay_timer = v[0x%x];\n", i->x);
+			return 1;
+		case CHIP8_OP_FX18:
+			flush_instruction_count(out, instructions);
+			fprintf(out, "\tupdate_timers(chip);\n");
+			fprintf(out, "\tchip->sound_timer = v[0x%x];\n", i->x);
+			return 1;
+		case CHIP8_OP_FX1E:
+			fprintf(out, "\tchip->index += v[0x%x];\n", i->x);
+			return 1;
+		case CHIP8_OP_FX29:
+			fprintf(out, "\tchip->index = CHIP8_FONT_SET_START_ADDRESS + (5 * v[0x%x]);\n", i->x);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static void emit_block(FILE* out, Chip8* chip, uint16_t address, uint16_t length) {
+	uint16_t instructions = 0;
+	int opcode_stored = 0;
+	int pc_stored = 0;
+	Chip8Instruction instruction;
+	char text[32];
+
+	fprintf(out, "static void block_%04x(Chip8* chip) {\n", address);
+	fprintf(out, "\tuint8_t* v = chip->registers;\n");
+	fprintf(out, "\tuint16_t sum;\n\n");
+	fprintf(out, "\t(void) v;\n");
+	fprintf(out, "\t(void) sum;\n");
+
+	for (uint16_t i = 0; i < length; i++) {
+		decode(chip, address, &instruction);
+		address += 2;
+
+		disassemble(instruction.opcode, text, sizeof(text));
+		fprintf(out, "\t// 0x%04x: %04x %s\n", address - 2, instruction.opcode, text);
+
+		if (emit_inline(out, &instruction, &instructions)) {
+			opcode_stored = 0;
+			pc_stored = instruction.op == CHIP8_OP_1NNN;
+		} else {
+			flush_instruction_count(out, &instructions);
+			fprintf(out, "\tchip->opcode = 0x%04x;\n", instruction.opcode);
+			fprintf(out, "\tchip->pc = 0x%04x;\n", address);
+
+			fprintf(out, "\tstatic const Chip8Instruction operands_%04x = "
+					"{ .opcode = 0x%04x, .nnn = 0x%03x, .x = 0x%x, .y = 0x%x, .kk = 0x%02x, .n = 0x%x };\n",
+					address - 2, instruction.opcode, instruction.nnn, instruction.x, instruction.y,
+					instruction.kk, instruction.n);
+
+			if (instruction.op == CHIP8_OP_CXKK) {
+				fprintf(out, "\top_cxkk(chip, &operands_%04x, generate_random_byte);\n", address - 2);
+			} else {
+				fprintf(out, "\t%s(chip, &operands_%04x);\n", handler_names[instruction.op], address - 2);
+			}
+
+			opcode_stored = 1;
+			pc_stored = 1;
+		}
+
+		instructions++;
+	}
+
+	if (!opcode_stored) {
+		fprintf(out, "\tchip->opcode = 0x%04x;\n", instruction.opcode);
+	}
+
+	if (!pc_stored) {
+		fprintf(out, "\tchip->pc = 0x%04x;\n", address);
+	}
+
+	flush_instruction_count(out, &instructions);
+	fprintf(out, "}\n\n");
+}
+
+int main(int argc, char** argv) {
+	if (argc != NUMBER_OF_ARGUMENTS) {
+		printf("Wrong number of arguments.\n");
+		printf("Expected %d, but got %d\n", NUMBER_OF_ARGUMENTS - 1, argc - 1);
+		printf("Usage: %s <rom> <output.c>\n", argv[0]);
+		return 1;
+	}
+
+	char* rom_file = argv[1];
+	char* output_file = argv[2];
+
+	Chip8* chip = create();
+	if (!chip) {
+		printf("%s\n", chip8_strerror(CHIP8_ERROR_OUT_OF_MEMORY));
+		return 1;
+	}
+
+	Chip8Error error = load_rom(chip, rom_file);
+	if (error) {
+		printf("Could not load %s: %s\n", rom_file,
+				error == CHIP8_ERROR_OPEN_FILE ? strerror(errno) : chip8_strerror(error));
+		return 1;
+	}
+
+	// An empty ROM would need an empty array initializer, which C before C23
+	// does not allow.
+	if (!chip->rom_size) {
+		printf("Could not recompile %s: the ROM is empty\n", rom_file);
+		return 1;
+	}
+
+	FILE* out = fopen(output_file, "w");
+	if (!out) {
+		printf("Could not open %s: %s\n", output_file, strerror(errno));
+		return 1;
+	}
+
+	static uint16_t lengths[CHIP8_MEMORY_SIZE];
+
+	add_block(CHIP8_ROM_START_ADDRESS);
+
+	while (pending_count) {
+		uint16_t address = pending[--pending_count];
+		lengths[address] = walk_block(chip, address);
+	}
+
+	fprintf(out, "// Generated by recompile from %s, do not edit.\n", rom_file);
+	fprintf(out, "#include \"chip8.h\"\n");
+	fprintf(out, "#include \"instructions.h\"\n");
+	fprintf(out, "#include \"aot.h\"\n\n");
+
+	for (uint16_t address = 0; address < CHIP8_MEMORY_SIZE; address++) {
+		if (is_block[address]) {
+			emit_block(out, chip, address, lengths[address]);
+		}
+	}
+
+	fprintf(out, "static const Chip8AotBlock blocks[] = {\n");
+	for (uint16_t address = 0; address < CHIP8_MEMORY_SIZE; address++) {
+		if (is_block[address]) {
+			fprintf(out, "\t{ 0x%04x, %u, block_%04x },\n", address, lengths[address], address);
+		}
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const uint8_t rom[] = {");
+	for (uint16_t i = 0; i < chip->rom_size; i++) {
+		fprintf(out, "%s0x%02x,", i % 12 ? " " : "\n\t", chip->memory[CHIP8_ROM_START_ADDRESS + i]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "const Chip8AotProgram chip8_aot_program = {\n");
+	fprintf(out, "\trom,\n");
+	fprintf(out, "\tsizeof(rom),\n");
+	fprintf(out, "\tblocks,\n");
+	fprintf(out, "\tsizeof(blocks) / sizeof(blocks[0]),\n");
+	fprintf(out, "};\n");
+
+	// A failed write leaves a truncated file, which must not pass for a
+	// recompiled ROM.
+	if (ferror(out) | fclose(out)) {
+		printf("Could not write %s: %s\n", output_file, strerror(errno));
+		return 1;
+	}
+	destroy(chip);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/rewind.h"
+
+#define ENTRY_SIZE_BYTES sizeof(uint32_t)
+
+Chip8Rewind* create_rewind(size_t budget) {
+	Chip8Rewind* history = calloc(1, sizeof(Chip8Rewind));
+
+	if (!history) {
+		return NULL;
+	}
+
+	history->capacity = budget;
+	history->buffer = malloc(budget ? budget : 1);
+
+	if (!history->buffer) {
+		rewind_destroy(history);
+		return NULL;
+	}
+
+	return history;
+}
+
+static uint8_t* write_varint(uint8_t* out, size_t value) {
+	while (value >= 0x80) {
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+
+	return out;
+}
+
+static const uint8_t* read_varint(const uint8_t* in, size_t* value) {
+	*value = 0;
+
+	for (int shift = 0;; shift += 7) {
+		*value |= (size_t)(*in & 0x7f) << shift;
+		if (!(*in++ & 0x80)) {
+			return in;
+		}
+	}
+}
+
+static int same_word(const uint8_t* a, const uint8_t* b) {
+	uint64_t x, y;
+	memcpy(&x, a, sizeof(x));
+	memcpy(&y, b, sizeof(y));
+
+	return x == y;
+}
+
+/*
+ * Encode the XOR of two machines as runs of unchanged bytes to skip and
+ * changed bytes to XOR in. A single unchanged byte does not end a run of
+ * changed ones, since skipping it costs more than storing it.
+ */
+static size_t encode_delta(const uint8_t* older, const uint8_t* newer, uint8_t* out) {
+	uint8_t* start = out;
+	size_t i = 0;
+	size_t last = 0;
+
+	for (;;) {
+		while (i + sizeof(uint64_t) <= CHIP8_MACHINE_SIZE && same_word(&older[i], &newer[i])) {
+			i += sizeof(uint64_t);
+		}
+		while (i < CHIP8_MACHINE_SIZE && older[i] == newer[i]) {
+			i++;
+		}
+		if (i == CHIP8_MACHINE_SIZE) {
+			break;
+		}
+
+		size_t first = i;
+		while (i < CHIP8_MACHINE_SIZE
+				&& (older[i] != newer[i] || (i + 1 < CHIP8_MACHINE_SIZE && older[i + 1] != newer[i + 1]))) {
+			i++;
+		}
+
+		out = write_varint(out, first - last);
+		out = write_varint(out, i - first);
+		for (size_t j = first; j < i; j++) {
+			*out++ = older[j] ^ newer[j];
+		}
+		last = i;
+	}
+
+	return out - start;
+}
+
+// XOR is its own inverse, so the same delta goes either way.
+static void apply_delta(uint8_t* machine, const uint8_t* in, size_t size) {
+	const uint8_t* end = in + size;
+	size_t i = 0;
+
+	while (in < end) {
+		size_t skip, length;
+		in = read_varint(in, &skip);
+		in = read_varint(in, &length);
+		i += skip;
+		for (size_t j = 0; j < length; j++) {
+			machine[i++] ^= *in++;
+		}
+	}
+}
+
+static void ring_write(Chip8Rewind* history, size_t offset, const void* data, size_t size) {
+	size_t first = size < history->capacity - offset ? size : history->capacity - offset;
+
+	memcpy(&history->buffer[offset], data, first);
+	memcpy(history->buffer, (const uint8_t*) data + first, size - first);
+}
+
+static void ring_read(Chip8Rewind* history, size_t offset, void* data, size_t size) {
+	size_t first = size < history->capacity - offset ? size : history->capacity - offset;
+
+	memcpy(data, &history->buffer[offset], first);
+	memcpy((uint8_t*) data + first, history->buffer, size - first);
+}
+
+static void drop_oldest(Chip8Rewind* history) {
+	uint32_t size;
+	ring_read(history, history->start, &size, ENTRY_SIZE_BYTES);
+
+	size_t entry = size + 2 * ENTRY_SIZE_BYTES;
+	history->start = (history->start + entry) % history->capacity;
+	history->used -= entry;
+	history->frame_count--;
+}
+
+void rewind_push(Chip8Rewind* history, const Chip8* chip) {
+	const uint8_t* machine = (const uint8_t*) chip;
+
+	if (!history->has_newest) {
+		chip8_save_state(chip, &history->newest);
+		history->has_newest = 1;
+		return;
+	}
+
+	uint32_t size = encode_delta(machine, history->newest.machine, history->delta);
+	size_t entry = size + 2 * ENTRY_SIZE_BYTES;
+	chip8_save_state(chip, &history->newest);
+
+	// A frame that does not fit in the whole budget cannot be gone back past.
+	if (entry > history->capacity) {
+		history->start = history->end = history->used = history->frame_count = 0;
+		return;
+	}
+
+	while (history->used + entry > history->capacity) {
+		drop_oldest(history);
+	}
+
+	size_t offset = history->end;
+	ring_write(history, offset, &size, ENTRY_SIZE_BYTES);
+	offset = (offset + ENTRY_SIZE_BYTES) % history->capacity;
+	ring_write(history, offset, history->delta, size);
+	offset = (offset + size) % history->capacity;
+	ring_write(history, offset, &size, ENTRY_SIZE_BYTES);
+	history->end = (offset + ENTRY_SIZE_BYTES) % history->capacity;
+	history->used += entry;
+	history->frame_count++;
+}
+
+int rewind_pop(Chip8Rewind* history, Chip8* chip) {
+	if (!history->frame_count) {
+		return -1;
+	}
+
+	uint32_t size;
+	size_t offset = (history->end + history->capacity - ENTRY_SIZE_BYTES) % history->capacity;
+	ring_read(history, offset, &size, ENTRY_SIZE_BYTES);
+	offset = (offset + history->capacity - size) % history->capacity;
+	ring_read(history, offset, history->delta, size);
+
+	history->end = (offset + history->capacity - ENTRY_SIZE_BYTES) % history->capacity;
+	history->used -= size + 2 * ENTRY_SIZE_BYTES;
+	history->frame_count--;
+
+	apply_delta(history->newest.machine, history->delta, size);
+	chip8_load_state(chip, &history->newest);
+
+	return 0;
+}
+
+void rewind_destroy(Chip8Rewind* history) {
+	if (!history) {
+		return;
+	}
+
+	free(history->buffer);
+	free(history);
+}
@@ -0,0 +1,150 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../inc/state.h"
+#include "../inc/jit.h"
+#include "../inc/aot.h"
+
+#define CHIP8_STATE_MAGIC "C8ST"
+#define CHIP8_STATE_MAGIC_SIZE 4
+#define CHIP8_STATE_PADDED_SIZE \
+	((CHIP8_MACHINE_SIZE + CHIP8_STATE_ALIGNMENT - 1) / CHIP8_STATE_ALIGNMENT * CHIP8_STATE_ALIGNMENT)
+#define CHIP8_MAPPED_SIZE \
+	((sizeof(Chip8) + CHIP8_STATE_ALIGNMENT - 1) / CHIP8_STATE_ALIGNMENT * CHIP8_STATE_ALIGNMENT)
+
+void chip8_save_state(const Chip8* chip, Chip8State* state) {
+	memcpy(state->machine, chip, CHIP8_MACHINE_SIZE);
+}
+
+void chip8_load_state(Chip8* chip, const Chip8State* state) {
+	load_machine(chip, state->machine);
+}
+
+static int write_zeros(FILE* f, size_t count) {
+	static const uint8_t zeros[CHIP8_STATE_ALIGNMENT];
+
+	while (count) {
+		size_t size = count < sizeof(zeros) ? count : sizeof(zeros);
+		if (fwrite(zeros, 1, size, f) != size) {
+			return -1;
+		}
+		count -= size;
+	}
+
+	return 0;
+}
+
+Chip8Error chip8_save_state_file(const Chip8* chip, char* path) {
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		return CHIP8_ERROR_OPEN_FILE;
+	}
+
+	Chip8StateHeader header = {
+		.version = CHIP8_STATE_VERSION,
+		.byte_order = CHIP8_STATE_BYTE_ORDER,
+		.machine_offset = CHIP8_STATE_ALIGNMENT,
+		.machine_size = CHIP8_MACHINE_SIZE,
+	};
+	memcpy(header.magic, CHIP8_STATE_MAGIC, CHIP8_STATE_MAGIC_SIZE);
+
+	int failed = fwrite(&header, sizeof(header), 1, f) != 1
+		|| write_zeros(f, CHIP8_STATE_ALIGNMENT - sizeof(header))
+		|| fwrite(chip, CHIP8_MACHINE_SIZE, 1, f) != 1
+		|| write_zeros(f, CHIP8_STATE_PADDED_SIZE - CHIP8_MACHINE_SIZE);
+
+	return fclose(f) || failed ? CHIP8_ERROR_WRITE_FILE : CHIP8_OK;
+}
+
+int is_state_header_valid(const Chip8StateHeader* header) {
+	return !memcmp(header->magic, CHIP8_STATE_MAGIC, CHIP8_STATE_MAGIC_SIZE)
+		&& header->version == CHIP8_STATE_VERSION
+		&& header->byte_order == CHIP8_STATE_BYTE_ORDER
+		&& header->machine_offset == CHIP8_STATE_ALIGNMENT
+		&& header->machine_size == CHIP8_MACHINE_SIZE;
+}
+
+Chip8Error chip8_load_state_file(Chip8* chip, char* path) {
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		return CHIP8_ERROR_OPEN_FILE;
+	}
+
+	Chip8StateHeader header;
+	Chip8State state;
+	int valid = fread(&header, sizeof(header), 1, f) == 1
+		&& is_state_header_valid(&header)
+		&& !fseek(f, header.machine_offset, SEEK_SET)
+		&& fread(state.machine, CHIP8_MACHINE_SIZE, 1, f) == 1;
+	fclose(f);
+
+	if (!valid) {
+		return CHIP8_ERROR_READ_FILE;
+	}
+
+	chip8_load_state(chip, &state);
+
+	return CHIP8_OK;
+}
+
+/*
+ * The chip is an anonymous mapping, zeroed like one from create(), with the
+ * pages of the machine replaced by the file. The padding of the file is zero
+ * as well, so the part of its last page past the machine reads as nothing
+ * decoded yet.
+ */
+Chip8Error chip8_map_state_file(Chip8** chip, char* path) {
+	*chip = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return CHIP8_ERROR_OPEN_FILE;
+	}
+
+	Chip8StateHeader header;
+	struct stat info;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| !is_state_header_valid(&header)
+			|| fstat(fd, &info)
+			|| (size_t) info.st_size < CHIP8_STATE_ALIGNMENT + CHIP8_STATE_PADDED_SIZE) {
+		close(fd);
+		return CHIP8_ERROR_READ_FILE;
+	}
+
+	uint8_t* base = mmap(NULL, CHIP8_MAPPED_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return CHIP8_ERROR_OUT_OF_MEMORY;
+	}
+
+	int mapped = CHIP8_STATE_ALIGNMENT % sysconf(_SC_PAGESIZE) == 0
+		&& mmap(base, CHIP8_STATE_PADDED_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+				fd, CHIP8_STATE_ALIGNMENT) != MAP_FAILED;
+
+	if (!mapped && pread(fd, base, CHIP8_MACHINE_SIZE, CHIP8_STATE_ALIGNMENT) != CHIP8_MACHINE_SIZE) {
+		munmap(base, CHIP8_MAPPED_SIZE);
+		close(fd);
+		return CHIP8_ERROR_READ_FILE;
+	}
+
+	close(fd);
+	*chip = (Chip8*) base;
+	// The saved rows were cleared when they were last shown, by whoever
+	// saved the state, so nothing has shown them to this process yet.
+	(*chip)->dirty_rows = 0xffffffff;
+
+	return CHIP8_OK;
+}
+
+void chip8_unmap_state_file(Chip8* chip) {
+	if (!chip) {
+		return;
+	}
+
+	jit_destroy(chip->jit);
+	aot_destroy(chip->aot);
+	munmap(chip, CHIP8_MAPPED_SIZE);
+}
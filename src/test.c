@@ -2,10 +2,20 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <pthread.h>
 #include <string.h>
 #include <time.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../inc/instructions.h"
+#include "../inc/aot.h"
+#include "../inc/lockstep.h"
+#include "../inc/frames.h"
+#include "../inc/movie.h"
+#include "../inc/pool.h"
+#include "../inc/state.h"
+#include "../inc/rewind.h"
 
 static uint32_t next = 1;
 
@@ -18,24 +28,46 @@ static uint8_t my_cute_rand(void) {
 	return (uint8_t) (next / 65536) % 32768;
 }
 
+static uint8_t my_cute_generator(Chip8* chip) {
+	return my_cute_rand();
+}
+
+// The operands of the opcode a test put in chip->opcode, as decode() extracts
+// them for the handlers.
+static const Chip8Instruction* operands_of(Chip8* chip) {
+	static Chip8Instruction instruction;
+	decode_operands(chip->opcode, &instruction);
+
+	return &instruction;
+}
+
 static void test_op_00e0_should_fill_memory_with_zeroes() {
 	Chip8 a;
 	memset(a.video, 1, sizeof(a.video));
 
-	op_00e0(&a);
+	op_00e0(&a, operands_of(&a));
 
-	for (int i = 0; i < CHIP8_PIXEL_COUNT; i++) {
+	for (int i = 0; i < CHIP8_SCREEN_HEIGHT; i++) {
 		assert_int_equal(a.video[i], 0);
 	}
 }
 
+static void test_op_00e0_should_mark_every_row_dirty() {
+	Chip8 a;
+	a.dirty_rows = 0;
+
+	op_00e0(&a, operands_of(&a));
+
+	assert_int_equal(a.dirty_rows, 0xffffffff);
+}
+
 static void test_op_00ee_should_set_the_pc_to_address_on_top_of_stack() {
 	Chip8 a;
 	a.sp = 0x05;
 	uint8_t previous_sp_value = a.sp - 1;
 	a.stack[previous_sp_value] = 0x10;
 
-	op_00ee(&a);
+	op_00ee(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, a.stack[a.sp]);
 }
@@ -45,7 +77,7 @@ static void test_op_00ee_should_decrease_sp_by_one() {
 	a.sp = 0x05;
 	uint8_t previous_sp_value = a.sp - 1;
 
-	op_00ee(&a);
+	op_00ee(&a, operands_of(&a));
 
 	assert_int_equal(a.sp, previous_sp_value);
 }
@@ -55,7 +87,7 @@ static void test_op_1nnn_should_set_the_pc_to_nnn() {
 	a.opcode = 0x9006;
 	uint16_t address = a.opcode & 0x0fffu;
 
-	op_1nnn(&a);
+	op_1nnn(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, address);
 }
@@ -68,7 +100,7 @@ static void test_op_2nnn_should_increment_the_sp() {
 	a.pc = 0x0020;
 	a.opcode = 0x9006;
 
-	op_2nnn(&a);
+	op_2nnn(&a, operands_of(&a));
 
 	assert_int_equal(a.sp, sp + 0x01u);
 }
@@ -81,11 +113,25 @@ static void test_op_2nnn_should_put_the_current_pc_on_the_top_of_the_stack() {
 	a.pc = 0x0020;
 	a.opcode = 0x9006;
 
-	op_2nnn(&a);
+	op_2nnn(&a, operands_of(&a));
 
 	assert_int_equal(a.stack[sp], 0x0020);
 }
 
+static void test_op_2nnn_should_wrap_around_a_full_stack() {
+	Chip8 a;
+	a.sp = CHIP8_STACK_SIZE + 1;
+	a.pc = 0x0020;
+	a.opcode = 0x2006;
+
+	op_2nnn(&a, operands_of(&a));
+	op_00ee(&a, operands_of(&a));
+
+	assert_int_equal(a.stack[0x01], 0x0020);
+	assert_int_equal(a.sp, CHIP8_STACK_SIZE + 1);
+	assert_int_equal(a.pc, 0x0020);
+}
+
 static void test_op_2nnn_should_set_the_pc_to_nnn() {
 	Chip8 a;
 	uint8_t sp = 0x0au;
@@ -95,7 +141,7 @@ static void test_op_2nnn_should_set_the_pc_to_nnn() {
 	a.opcode = 0x9006;
 	uint16_t address = a.opcode & 0x0fffu;
 
-	op_2nnn(&a);
+	op_2nnn(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, address);
 }
@@ -107,7 +153,7 @@ static void test_op_3xkk_should_increment_pc_by_two_if_vx_and_kk_are_equal() {
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_3xkk(&a);
+	op_3xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -119,7 +165,7 @@ static void test_op_3xkk_should_maintain_pc_if_vx_and_kk_are_different() {
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_3xkk(&a);
+	op_3xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc);
 }
@@ -131,7 +177,7 @@ static void test_op_3xkk_should_increase_pc_by_two_if_leftmost_byte_is_different
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_3xkk(&a);
+	op_3xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -143,7 +189,7 @@ static void test_op_4xkk_should_increment_pc_by_two_if_vx_and_kk_are_different()
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_4xkk(&a);
+	op_4xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -155,7 +201,7 @@ static void test_op_4xkk_should_maintain_pc_if_vx_and_kk_are_equal() {
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_4xkk(&a);
+	op_4xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc);
 }
@@ -167,7 +213,7 @@ static void test_op_4xkk_should_increase_pc_by_two_if_leftmost_byte_is_different
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_4xkk(&a);
+	op_4xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -180,7 +226,7 @@ static void test_op_5xy0_should_increment_pc_by_two_if_vx_and_vy_are_equal() {
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_5xy0(&a);
+	op_5xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -193,7 +239,7 @@ static void test_op_5xy0_should_maintain_pc_if_vx_and_vy_are_different() {
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_5xy0(&a);
+	op_5xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc);
 }
@@ -206,7 +252,7 @@ static void test_op_5xy0_should_increase_pc_by_two_if_leftmost_byte_is_different
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_5xy0(&a);
+	op_5xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -219,7 +265,7 @@ static void test_op_5xy0_should_increase_pc_by_two_if_rightmost_byte_is_differen
 	uint16_t pc = 0x0050u;
 	a.pc = pc;
 
-	op_5xy0(&a);
+	op_5xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, pc + 2);
 }
@@ -231,7 +277,7 @@ static void test_op_6xkk_should_save_kk_in_register_vx() {
 	a.opcode = (vx << 8u) + kk;
 	a.registers[vx] = 0x00;
 
-	op_6xkk(&a);
+	op_6xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], kk);
 }
@@ -244,7 +290,7 @@ static void test_op_7xkk_should_add_kk_to_register_vx() {
 	a.opcode = (vx << 8u) + kk;
 	a.registers[vx] = previous_value;
 
-	op_7xkk(&a);
+	op_7xkk(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], previous_value + kk);
 }
@@ -258,7 +304,7 @@ static void test_op_8xy0_should_save_vy_in_vx() {
 	a.registers[vx] = 0x00;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy0(&a);
+	op_8xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], vy_value);
 }
@@ -273,7 +319,7 @@ static void test_op_8xy1_should_set_vx_or_vy_to_register_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy1(&a);
+	op_8xy1(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], vx_value | vy_value);
 }
@@ -288,7 +334,7 @@ static void test_op_8xy2_should_set_vx_and_vy_to_register_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy2(&a);
+	op_8xy2(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], vx_value & vy_value);
 }
@@ -303,7 +349,7 @@ static void test_op_8xy3_should_set_vx_xor_vy_to_register_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy3(&a);
+	op_8xy3(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], vx_value ^ vy_value);
 }
@@ -318,7 +364,7 @@ static void test_op_8xy4_should_set_vx_plus_vy_to_register_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy4(&a);
+	op_8xy4(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], vx_value + vy_value);
 }
@@ -334,7 +380,7 @@ static void test_op_8xy4_should_set_overflow_flag_on_sums_bigger_than_size() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy4(&a);
+	op_8xy4(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], sum & 0xffu);
 	assert_int_equal(a.registers[0xf], 1);
@@ -351,7 +397,7 @@ static void test_op_8xy5_should_set_vx_minus_vy_to_register_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy5(&a);
+	op_8xy5(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], sub);
 }
@@ -367,7 +413,7 @@ static void test_op_8xy5_should_set_1_to_vf_if_vx_greater_than_vy() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy5(&a);
+	op_8xy5(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], sub);
 	assert_int_equal(a.registers[0xf], 1);
@@ -384,7 +430,7 @@ static void test_op_8xy5_should_set_0_to_vf_if_vx_lesser_than_vy() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy5(&a);
+	op_8xy5(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], sub & 0xffu);
 	assert_int_equal(a.registers[0xf], 0);
@@ -399,7 +445,7 @@ static void test_op_8xy6_should_set_the_least_significant_bit_of_vx_to_vf() {
 
 	uint8_t least_significant_bit = (vx_value & 0x1u);
 
-	op_8xy6(&a);
+	op_8xy6(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], least_significant_bit);
 }
@@ -411,7 +457,7 @@ static void test_op_8xy6_should_divide_vx_by_2() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u);
 
-	op_8xy6(&a);
+	op_8xy6(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], (vx_value >> 1));
 }
@@ -427,7 +473,7 @@ static void test_op_8xy7_should_set_vx_to_vy_minus_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy7(&a);
+	op_8xy7(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], sub);
 }
@@ -442,7 +488,7 @@ static void test_op_8xy7_should_set_vf_to_1_if_vy_greater_than_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy7(&a);
+	op_8xy7(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], 1);
 }
@@ -457,7 +503,7 @@ static void test_op_8xy7_should_set_vf_to_0_if_vy_lesser_than_vx() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_8xy7(&a);
+	op_8xy7(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], 0);
 }
@@ -469,7 +515,7 @@ static void test_op_8xye_should_multiply_vx_by_two() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u);
 
-	op_8xye(&a);
+	op_8xye(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], (vx_value << 1));
 }
@@ -481,7 +527,7 @@ static void test_op_8xye_should_set_vf_to_1_if_most_significant_bit_is_1() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u);
 
-	op_8xye(&a);
+	op_8xye(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], 1);
 }
@@ -493,7 +539,7 @@ static void test_op_8xye_should_set_vf_to_0_if_most_significant_bit_is_0() {
 	a.registers[vx] = vx_value;
 	a.opcode = (vx << 8u);
 
-	op_8xye(&a);
+	op_8xye(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], 0);
 }
@@ -509,7 +555,7 @@ static void test_op_9xy0_should_increment_pc_by_two_if_vx_is_different_than_vy()
 	a.registers[vy] = vy_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_9xy0(&a);
+	op_9xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 2);
 }
@@ -525,7 +571,7 @@ static void test_op_9xy0_should_maintain_pc_if_vx_is_equal_to_vy() {
 	a.registers[vy] = vy_value;
 	a.opcode = (vx << 8u) + (vy << 4u);
 
-	op_9xy0(&a);
+	op_9xy0(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0);
 }
@@ -534,7 +580,7 @@ static void test_op_annn_should_set_nnn_to_index() {
 	Chip8 a;
 	a.opcode = 0xa123;
 
-	op_annn(&a);
+	op_annn(&a, operands_of(&a));
 
 	assert_int_equal(a.index, 0x0123);
 }
@@ -544,7 +590,7 @@ static void test_op_bnnn_should_set_pc_to_nnn_plus_v0() {
 	a.opcode = 0xb123;
 	a.registers[0] = 0x50;
 
-	op_bnnn(&a);
+	op_bnnn(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0x0173);
 }
@@ -557,7 +603,7 @@ static void test_op_cxkk_should_set_vx_to_kk_and_a_random_number_between_0_and_2
 	uint8_t kk = 0xff;
 	a.opcode = (vx << 8u) + kk;
 
-	op_cxkk(&a, my_cute_rand);
+	op_cxkk(&a, operands_of(&a), my_cute_generator);
 
 	assert_in_range(a.registers[vx], 0, 255);
 }
@@ -570,7 +616,7 @@ static void test_op_cxkk_should_set_vx_to_zero_if_kk_is_zero() {
 	uint8_t kk = 0x00;
 	a.opcode = (vx << 8u) + kk;
 
-	op_cxkk(&a, my_cute_rand);
+	op_cxkk(&a, operands_of(&a), my_cute_generator);
 
 	assert_int_equal(a.registers[vx], 0);
 }
@@ -585,11 +631,51 @@ static void test_op_cxkk_should_set_vx_to_kk_and_a_random_number() {
 
 	my_cute_srand(0xfaaffaaf);
 
-	op_cxkk(&a, my_cute_rand);
+	op_cxkk(&a, operands_of(&a), my_cute_generator);
 
 	assert_int_equal(a.registers[vx], 0xa9);
 }
 
+static void test_generate_random_byte_should_repeat_for_the_same_seed() {
+	Chip8 a;
+	Chip8 b;
+	seed_random(&a, 0x1234);
+	seed_random(&b, 0x1234);
+
+	for (int i = 0; i < 64; i++) {
+		assert_int_equal(generate_random_byte(&a), generate_random_byte(&b));
+	}
+}
+
+static void test_generate_random_byte_should_differ_for_different_seeds() {
+	Chip8 a;
+	Chip8 b;
+	seed_random(&a, 0x1234);
+	seed_random(&b, 0x1235);
+	int same = 0;
+
+	for (int i = 0; i < 64; i++) {
+		same += generate_random_byte(&a) == generate_random_byte(&b);
+	}
+
+	assert_in_range(same, 0, 8);
+}
+
+static void test_cycle_should_use_the_chip_generator_for_cxkk() {
+	Chip8* a = create();
+	Chip8 b;
+	seed_random(a, 0xfaaffaaf);
+	seed_random(&b, 0xfaaffaaf);
+	a->memory[0x200] = 0xc3;
+	a->memory[0x201] = 0xff;
+
+	cycle(a);
+
+	assert_int_equal(a->registers[0x3], generate_random_byte(&b));
+
+	destroy(a);
+}
+
 static void test_op_dxyn_draws_sprite_in_position_defined_by_vx_and_vy() {
 	Chip8 a;
 	a.index = 0x00ff;
@@ -610,15 +696,87 @@ static void test_op_dxyn_draws_sprite_in_position_defined_by_vx_and_vy() {
 	a.registers[vy] = vy_value;
 	a.opcode = 0xd000 + (vx << 8u) + (vy << 4u) + n;
 
-	op_dxyn(&a);
+	op_dxyn(&a, operands_of(&a));
+
+	uint32_t pixels[CHIP8_PIXEL_COUNT];
+	expand_video(&a, pixels);
 
 	for (uint8_t row = 0; row < n; ++row) {
 		for (int column = 0; column < 8; ++column) {
-			assert_int_equal(a.video[(vy_value + row) * CHIP8_SCREEN_WIDTH + (vx_value + column)], 0xffffffff);
+			assert_int_equal(pixels[(vy_value + row) * CHIP8_SCREEN_WIDTH + (vx_value + column)], 0xffffffff);
 		}
 	}
 }
 
+static void test_op_dxyn_wraps_sprite_around_the_screen() {
+	Chip8 a;
+	a.index = 0x00ff;
+	a.memory[a.index] = 0xff;
+	a.memory[a.index + 1] = 0x81;
+
+	memset(a.video, 0x00, sizeof(a.video));
+
+	a.registers[0x2] = 60;
+	a.registers[0x3] = 31;
+	a.opcode = 0xd232;
+
+	op_dxyn(&a, operands_of(&a));
+
+	assert_int_equal(a.video[31], 0xf00000000000000full);
+	assert_int_equal(a.video[0], 0x1000000000000008ull);
+	assert_int_equal(a.registers[0xf], 0x00);
+}
+
+static void test_op_dxyn_sets_vf_to_0_if_there_is_no_sprite_collision() {
+	Chip8 a;
+	a.index = 0x00ff;
+	a.memory[a.index] = 0xf0;
+
+	memset(a.video, 0x00, sizeof(a.video));
+	a.video[0] = 0x0f00000000000000ull;
+
+	a.registers[0x2] = 0;
+	a.opcode = 0xd221;
+
+	op_dxyn(&a, operands_of(&a));
+
+	assert_int_equal(a.video[0], 0xff00000000000000ull);
+	assert_int_equal(a.registers[0xf], 0x00);
+}
+
+static void test_op_dxyn_should_mark_only_changed_rows_dirty() {
+	Chip8 a;
+	a.index = 0x00ff;
+	a.memory[a.index] = 0xff;
+	a.memory[a.index + 1] = 0x00;
+	a.memory[a.index + 2] = 0x81;
+
+	memset(a.video, 0x00, sizeof(a.video));
+	a.dirty_rows = 0;
+
+	a.registers[0x2] = 0;
+	a.registers[0x3] = 30;
+	a.opcode = 0xd233;
+
+	op_dxyn(&a, operands_of(&a));
+
+	assert_int_equal(a.dirty_rows, (1u << 30) | (1u << 0));
+}
+
+static void test_expand_video_should_set_one_pixel_per_bit() {
+	Chip8 a;
+	memset(a.video, 0x00, sizeof(a.video));
+	a.video[1] = 0x8000000000000001ull;
+
+	uint32_t pixels[CHIP8_PIXEL_COUNT];
+	expand_video(&a, pixels);
+
+	for (int i = 0; i < CHIP8_PIXEL_COUNT; i++) {
+		int lit = i == CHIP8_SCREEN_WIDTH || i == 2 * CHIP8_SCREEN_WIDTH - 1;
+		assert_int_equal(pixels[i], lit ? CHIP8_PIXEL_ON : 0);
+	}
+}
+
 static void test_op_dxyn_sets_vf_to_1_if_there_is_sprite_collision() {
 	Chip8 a;
 	a.index = 0x00ff;
@@ -639,7 +797,7 @@ static void test_op_dxyn_sets_vf_to_1_if_there_is_sprite_collision() {
 	a.registers[vy] = vy_value;
 	a.opcode = 0xd000 + (vx << 8u) + (vy << 4u) + n;
 
-	op_dxyn(&a);
+	op_dxyn(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0xf], 0x01);
 }
@@ -653,7 +811,21 @@ static void test_op_ex9e_should_increment_pc_if_key_with_the_value_of_vx_is_pres
 	a.opcode = (vx << 8u) + 0xe09e;
 	a.pc = 0x0000;
 
-	op_ex9e(&a);
+	op_ex9e(&a, operands_of(&a));
+
+	assert_int_equal(a.pc, 0x0002);
+}
+
+static void test_op_ex9e_should_wrap_vx_around_the_keypad() {
+	Chip8 a;
+	memset(a.keypad, 0, sizeof(a.keypad));
+	uint8_t vx = 0x02;
+	a.registers[vx] = 0x13;
+	a.keypad[0x3] = 0xff;
+	a.opcode = (vx << 8u) + 0xe09e;
+	a.pc = 0x0000;
+
+	op_ex9e(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0x0002);
 }
@@ -667,7 +839,7 @@ static void test_op_ex9e_should_not_increment_pc_if_key_with_the_value_of_vx_is_
 	a.opcode = (vx << 8u) + 0xe09e;
 	a.pc = 0x0000;
 
-	op_ex9e(&a);
+	op_ex9e(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0x0000);
 }
@@ -681,7 +853,7 @@ static void test_op_exa1_should_not_increment_pc_if_key_with_the_value_of_vx_is_
 	a.opcode = (vx << 8u) + 0xe0a1;
 	a.pc = 0x0000;
 
-	op_exa1(&a);
+	op_exa1(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0x0000);
 }
@@ -695,7 +867,7 @@ static void test_op_exa1_should_increment_pc_if_key_with_the_value_of_vx_is_not_
 	a.opcode = (vx << 8u) + 0xe0a1;
 	a.pc = 0x0000;
 
-	op_exa1(&a);
+	op_exa1(&a, operands_of(&a));
 
 	assert_int_equal(a.pc, 0x0002);
 }
@@ -708,7 +880,7 @@ static void test_op_fx07_should_set_vx_to_the_value_of_delay_timer() {
 	a.opcode = (vx << 8u) + 0xf007;
 	a.delay_timer = 0x15;
 
-	op_fx07(&a);
+	op_fx07(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[vx], a.delay_timer);
 }
@@ -723,22 +895,33 @@ static void test_op_fx0a_should_set_vx_to_the_value_of_the_key_pressed() {
 	a->opcode = (vx << 8u) + 0xf00a;
 	a->keypad[i] = 1;
 
-	op_fx0a(a);
+	op_fx0a(a, operands_of(a));
 
 	assert_int_equal(a->registers[vx], i);
 
 	destroy(a);
 }
 
-static void test_op_fx0a_should_increment_pc_if_no_key_is_pressed() {
+static void test_op_fx0a_should_wait_on_the_same_instruction_if_no_key_is_pressed() {
 	Chip8* a = create();
 	uint8_t vx = 0x02;
 	a->opcode = (vx << 8u) + 0xf00a;
-	a->pc = 0x0020;
+	a->pc = 0x0022;
 
-	op_fx0a(a);
+	op_fx0a(a, operands_of(a));
 
 	assert_int_equal(a->pc, 0x0020);
+	assert_int_equal(a->opcode, 0xf20a);
+	assert_true(a->waiting_for_key);
+
+	a->keypad[0x7] = 1;
+	a->pc = 0x0022;
+
+	op_fx0a(a, operands_of(a));
+
+	assert_int_equal(a->pc, 0x0022);
+	assert_int_equal(a->registers[vx], 0x07);
+	assert_false(a->waiting_for_key);
 
 	destroy(a);
 }
@@ -751,7 +934,7 @@ static void test_op_fx15_should_set_delay_timer_to_the_value_of_vx() {
 	a.opcode = (vx << 8u) + 0xf015;
 	a.delay_timer = 0x15;
 
-	op_fx15(&a);
+	op_fx15(&a, operands_of(&a));
 
 	assert_int_equal(a.delay_timer, vx_value);
 }
@@ -764,7 +947,7 @@ static void test_op_fx18_should_set_sound_timer_to_the_value_of_vx() {
 	a.opcode = (vx << 8u) + 0xf018;
 	a.sound_timer = 0x15;
 
-	op_fx18(&a);
+	op_fx18(&a, operands_of(&a));
 
 	assert_int_equal(a.sound_timer, vx_value);
 }
@@ -777,7 +960,7 @@ static void test_op_fx1e_should_increment_index_by_the_value_of_vx() {
 	a.opcode = (vx << 8u) + 0xf01e;
 	a.index = 0x0008;
 
-	op_fx1e(&a);
+	op_fx1e(&a, operands_of(&a));
 
 	assert_int_equal(a.index, 0x000c);
 }
@@ -790,7 +973,7 @@ static void test_op_fx29_should_set_index_to_the_location_for_the_hexadecimal_sp
 	a.opcode = (vx << 8u) + 0xf029;
 	a.index = 0x0000;
 
-	op_fx29(&a);
+	op_fx29(&a, operands_of(&a));
 
 	assert_int_equal(a.index, 0x0064);
 }
@@ -803,7 +986,7 @@ static void test_op_fx33_should_store_bcd_representation_of_vx_in_memory_locatio
 	a.opcode = (vx << 8u) + 0xf033;
 	a.index = 0x0005;
 
-	op_fx33(&a);
+	op_fx33(&a, operands_of(&a));
 
 	assert_int_equal(a.memory[a.index], 1);
 	assert_int_equal(a.memory[a.index + 1], 2);
@@ -819,7 +1002,7 @@ static void test_op_fx55_should_store_registers_v0_through_vx_in_memory_starting
 	a.registers[0x02] = 0x02;
 	a.index = 0x0005;
 
-	op_fx55(&a);
+	op_fx55(&a, operands_of(&a));
 
 	assert_int_equal(a.memory[a.index], a.registers[0x00]);
 	assert_int_equal(a.memory[a.index + 1], a.registers[0x01]);
@@ -835,22 +1018,1451 @@ static void test_op_fx65_should_read_registers_v0_through_vx_from_memory_startin
 	a.memory[a.index + 1] = 0x01;
 	a.memory[a.index + 2] = 0x02;
 
-	op_fx65(&a);
+	op_fx65(&a, operands_of(&a));
 
 	assert_int_equal(a.registers[0x00], a.memory[a.index]);
 	assert_int_equal(a.registers[0x01], a.memory[a.index + 1]);
 	assert_int_equal(a.registers[0x02], a.memory[a.index + 2]);
 }
 
+static void test_op_fx55_should_wrap_around_the_end_of_memory() {
+	Chip8* a = create();
+	a->memory[0x000] = 0x12;
+	a->memory[0x001] = 0x00;
+	a->pc = 0x0000;
+	cycle(a);
+	uint8_t vx = 0x03;
+	a->opcode = (vx << 8u) + 0xf055;
+	a->registers[0x00] = 0x10;
+	a->registers[0x01] = 0x11;
+	a->registers[0x02] = 0x12;
+	a->registers[0x03] = 0x13;
+	a->index = 0x0ffe;
+
+	op_fx55(a, operands_of(a));
+
+	assert_int_equal(a->memory[0xffe], 0x10);
+	assert_int_equal(a->memory[0xfff], 0x11);
+	assert_int_equal(a->memory[0x000], 0x12);
+	assert_int_equal(a->memory[0x001], 0x13);
+	assert_null(a->decoded[0x000].handler);
+	assert_null(a->decoded[0xfff].handler);
+
+	destroy(a);
+}
+
+static void test_run_should_wrap_the_fetch_past_the_end_of_memory_on_every_engine() {
+	Chip8Engine engines[] = { CHIP8_ENGINE_TABLE, CHIP8_ENGINE_FLAT, CHIP8_ENGINE_THREADED, CHIP8_ENGINE_JIT };
+
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		Chip8* a = create();
+		// 0xfff: ADD V1, 0x01, its low byte wrapped around to 0x000.
+		a->memory[0xfff] = 0x71;
+		a->memory[0x000] = 0x01;
+		// 0x200: ADD V2, 0x01, then a jump back to itself.
+		a->memory[0x200] = 0x72;
+		a->memory[0x201] = 0x01;
+		a->memory[0x202] = 0x12;
+		a->memory[0x203] = 0x00;
+		a->pc = 0x0fff;
+		a->engine = engines[i];
+
+		run(a, 1);
+		// pc is 0x1001, which fetches from 0x001.
+		assert_int_equal(a->pc, 0x1001);
+
+		a->pc = 0x1200;
+		run(a, 4);
+
+		assert_int_equal(a->registers[0x1], 0x01);
+		assert_int_equal(a->registers[0x2], 0x02);
+		assert_int_equal(a->pc, 0x0200);
+
+		destroy(a);
+	}
+}
+
+#define ISA_ENTRY(OP, handler, mask, pattern, syntax) { CHIP8_OP_##OP, mask, pattern },
+
+static const struct {
+	Chip8Op op;
+	uint16_t mask;
+	uint16_t pattern;
+} isa[] = {
+	CHIP8_ISA(ISA_ENTRY)
+};
+
+static void test_identify_should_decode_every_instruction_whatever_its_operands() {
+	for (size_t i = 0; i < sizeof(isa) / sizeof(isa[0]); i++) {
+		uint16_t operands = ~isa[i].mask;
+
+		assert_int_equal(identify(isa[i].pattern), isa[i].op);
+		assert_int_equal(identify(isa[i].pattern | operands), isa[i].op);
+		assert_int_equal(identify(isa[i].pattern | (operands & 0x0a5a)), isa[i].op);
+	}
+}
+
+static void test_identify_should_return_null_outside_the_instruction_set() {
+	uint16_t opcodes[] = { 0x0000, 0x0123, 0x00e1, 0x5001, 0x8008, 0x800f, 0x9ab1, 0xe19f, 0xe0a2, 0xf000, 0xf1ff };
+
+	for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); i++) {
+		assert_int_equal(identify(opcodes[i]), CHIP8_OP_NULL);
+	}
+}
+
+static void test_identify_should_match_exactly_one_instruction_per_opcode() {
+	for (uint32_t opcode = 0; opcode <= 0xffff; opcode++) {
+		int matches = 0;
+
+		for (size_t i = 0; i < sizeof(isa) / sizeof(isa[0]); i++) {
+			matches += (opcode & isa[i].mask) == isa[i].pattern;
+		}
+
+		assert_true(matches <= 1);
+		assert_int_equal(identify(opcode) != CHIP8_OP_NULL, matches);
+	}
+}
+
+static void test_disassemble_should_fill_in_the_operands() {
+	char text[32];
+
+	disassemble(0x00e0, text, sizeof(text));
+	assert_string_equal(text, "CLS");
+	disassemble(0x1a2c, text, sizeof(text));
+	assert_string_equal(text, "JP 0xa2c");
+	disassemble(0x6c0f, text, sizeof(text));
+	assert_string_equal(text, "LD VC, 0x0f");
+	disassemble(0x8ab4, text, sizeof(text));
+	assert_string_equal(text, "ADD VA, VB");
+	disassemble(0xb300, text, sizeof(text));
+	assert_string_equal(text, "JP V0, 0x300");
+	disassemble(0xd12f, text, sizeof(text));
+	assert_string_equal(text, "DRW V1, V2, 15");
+	disassemble(0xf965, text, sizeof(text));
+	assert_string_equal(text, "LD V9, [I]");
+}
+
+static void test_disassemble_should_write_unknown_opcodes_as_data() {
+	char text[32];
+
+	disassemble(0x0123, text, sizeof(text));
+
+	assert_string_equal(text, "DW 0x0123");
+}
+
+static void test_disassemble_should_truncate_to_the_buffer_size() {
+	char text[8];
+
+	memset(text, 'x', sizeof(text));
+	disassemble(0xd12f, text, sizeof(text));
+
+	assert_string_equal(text, "DRW V1,");
+}
+
+static void test_cycle_should_execute_the_instruction_at_pc() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x6a;
+	a->memory[0x201] = 0x42;
+
+	cycle(a);
+
+	assert_int_equal(a->registers[0xa], 0x42);
+	assert_int_equal(a->pc, 0x202);
+
+	destroy(a);
+}
+
+static void test_cycle_should_execute_instruction_modified_by_fx33() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x7a;
+	a->memory[0x201] = 0x01;
+
+	cycle(a);
+
+	a->registers[0x3] = 200;
+	a->index = 0x0201;
+	a->opcode = 0xf333;
+	op_fx33(a, operands_of(a));
+
+	a->pc = 0x200;
+	cycle(a);
+
+	assert_int_equal(a->registers[0xa], 0x03);
+
+	destroy(a);
+}
+
+static void test_cycle_should_execute_instruction_modified_by_fx55() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x6a;
+	a->memory[0x201] = 0x01;
+
+	cycle(a);
+
+	a->registers[0x0] = 0x6a;
+	a->registers[0x1] = 0x02;
+	a->index = 0x0200;
+	a->opcode = 0xf155;
+	op_fx55(a, operands_of(a));
+
+	a->pc = 0x200;
+	cycle(a);
+
+	assert_int_equal(a->registers[0xa], 0x02);
+
+	destroy(a);
+}
+
+static uint8_t engine_test_program[] = {
+	0x60, 0x05, // 0x200: LD V0, 0x05
+	0x61, 0x0a, // 0x202: LD V1, 0x0a
+	0x6c, 0xff, // 0x204: LD VC, 0xff
+	0x80, 0x14, // 0x206: ADD V0, V1
+	0x8c, 0x14, // 0x208: ADD VC, V1
+	0x80, 0x15, // 0x20a: SUB V0, V1
+	0x81, 0x07, // 0x20c: SUBN V1, V0
+	0x82, 0x06, // 0x20e: SHR V2
+	0x8c, 0x0e, // 0x210: SHL VC
+	0x83, 0x11, // 0x212: OR V3, V1
+	0x83, 0x02, // 0x214: AND V3, V0
+	0x84, 0x13, // 0x216: XOR V4, V1
+	0xa3, 0x00, // 0x218: LD I, 0x300
+	0xf0, 0x33, // 0x21a: LD B, V0
+	0xf2, 0x65, // 0x21c: LD V2, [I]
+	0x22, 0x40, // 0x21e: CALL 0x240
+	0x75, 0x01, // 0x220: ADD V5, 0x01
+	0x35, 0x05, // 0x222: SE V5, 0x05
+	0x12, 0x20, // 0x224: JP 0x220
+	0xf5, 0x29, // 0x226: LD F, V5
+	0xd6, 0x75, // 0x228: DRW V6, V7, 5
+	0xd6, 0x75, // 0x22a: DRW V6, V7, 5
+	0xf5, 0x15, // 0x22c: LD DT, V5
+	0xf8, 0x07, // 0x22e: LD V8, DT
+	0x38, 0x00, // 0x230: SE V8, 0x00
+	0x12, 0x2e, // 0x232: JP 0x22e
+	0xc9, 0xff, // 0x234: RND V9, 0xff
+	0x12, 0x36, // 0x236: JP 0x236
+};
+
+static uint8_t engine_test_subroutine[] = {
+	0x66, 0x3e, // 0x240: LD V6, 0x3e
+	0x67, 0x1d, // 0x242: LD V7, 0x1d
+	0x00, 0xee, // 0x244: RET
+};
+
+static Chip8* run_engine_test_program(Chip8Engine engine, uint32_t count) {
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], engine_test_program, sizeof(engine_test_program));
+	memcpy(&a->memory[0x240], engine_test_subroutine, sizeof(engine_test_subroutine));
+	seed_random(a, 0xc0ffee);
+	a->engine = engine;
+
+	run(a, count);
+
+	return a;
+}
+
+static void assert_same_state(Chip8* a, Chip8* b) {
+	assert_memory_equal(a->registers, b->registers, sizeof(a->registers));
+	assert_memory_equal(a->memory, b->memory, sizeof(a->memory));
+	assert_memory_equal(a->stack, b->stack, sizeof(a->stack));
+	assert_memory_equal(a->video, b->video, sizeof(a->video));
+	assert_int_equal(a->dirty_rows, b->dirty_rows);
+	assert_int_equal(a->index, b->index);
+	assert_int_equal(a->pc, b->pc);
+	assert_int_equal(a->waiting_for_key, b->waiting_for_key);
+	assert_int_equal(a->sp, b->sp);
+	assert_int_equal(a->delay_timer, b->delay_timer);
+	assert_int_equal(a->sound_timer, b->sound_timer);
+	assert_int_equal(a->opcode, b->opcode);
+	assert_int_equal(a->instruction_count, b->instruction_count);
+}
+
+static void test_run_threaded_engine_should_match_table_engine() {
+	for (uint32_t count = 0; count < 160; count++) {
+		Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, count);
+		Chip8* b = run_engine_test_program(CHIP8_ENGINE_THREADED, count);
+
+		assert_same_state(a, b);
+
+		destroy(a);
+		destroy(b);
+	}
+}
+
+static void test_run_jit_engine_should_match_table_engine() {
+	for (uint32_t count = 0; count < 160; count++) {
+		Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, count);
+		Chip8* b = run_engine_test_program(CHIP8_ENGINE_JIT, count);
+
+		assert_same_state(a, b);
+
+		destroy(a);
+		destroy(b);
+	}
+}
+
+static uint8_t fused_test_program[] = {
+	0x6a, 0x00, // 0x200: LD VA, 0x00
+	0x6b, 0x03, // 0x202: LD VB, 0x03
+	0xfb, 0x15, // 0x204: LD DT, VB
+	0xfc, 0x07, // 0x206: LD VC, DT
+	0x3c, 0x00, // 0x208: SE VC, 0x00
+	0x12, 0x06, // 0x20a: JP 0x206
+	0xa2, 0x30, // 0x20c: LD I, 0x230
+	0xd0, 0xa1, // 0x20e: DRW V0, VA, 1
+	0x7a, 0x01, // 0x210: ADD VA, 0x01
+	0x3a, 0x04, // 0x212: SE VA, 0x04
+	0x12, 0x0c, // 0x214: JP 0x20c
+	0x12, 0x00, // 0x216: JP 0x200
+};
+
+static void test_run_should_match_cycle_on_fused_instructions() {
+	for (uint32_t count = 0; count < 200; count++) {
+		Chip8* a = create();
+		Chip8* b = create();
+		memcpy(&a->memory[0x200], fused_test_program, sizeof(fused_test_program));
+		memcpy(&b->memory[0x200], fused_test_program, sizeof(fused_test_program));
+		a->memory[0x230] = 0xf0;
+		b->memory[0x230] = 0xf0;
+		a->instructions_per_tick = 2;
+		b->instructions_per_tick = 2;
+
+		run(a, count);
+		for (uint32_t i = 0; i < count; i++) {
+			cycle(b);
+		}
+		update_timers(b);
+
+		assert_same_state(a, b);
+
+		destroy(a);
+		destroy(b);
+	}
+}
+
+static void test_run_should_execute_fused_instructions_modified_by_fx55() {
+	uint8_t program[] = {
+		0x6a, 0x01, // 0x200: LD VA, 0x01
+		0x6b, 0x02, // 0x202: LD VB, 0x02
+		0x60, 0x6b, // 0x204: LD V0, 0x6b
+		0x61, 0x07, // 0x206: LD V1, 0x07
+		0xa2, 0x02, // 0x208: LD I, 0x202
+		0xf1, 0x55, // 0x20a: LD [I], V1
+		0x12, 0x00, // 0x20c: JP 0x200
+	};
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], program, sizeof(program));
+
+	run(a, 9);
+
+	assert_int_equal(a->registers[0xb], 0x07);
+	assert_int_equal(a->pc, 0x204);
+
+	destroy(a);
+}
+
+static uint8_t idle_test_program[] = {
+	0x6b, 0x05, // 0x200: LD VB, 0x05
+	0xfb, 0x15, // 0x202: LD DT, VB
+	0xfc, 0x07, // 0x204: LD VC, DT
+	0x3c, 0x00, // 0x206: SE VC, 0x00
+	0x12, 0x04, // 0x208: JP 0x204
+	0x6d, 0x03, // 0x20a: LD VD, 0x03
+	0xfd, 0x15, // 0x20c: LD DT, VD
+	0xfc, 0x07, // 0x20e: LD VC, DT
+	0x3c, 0x01, // 0x210: SE VC, 0x01
+	0x12, 0x0e, // 0x212: JP 0x20e
+	0xe1, 0x9e, // 0x214: SKP V1
+	0x12, 0x14, // 0x216: JP 0x214
+	0x12, 0x18, // 0x218: JP 0x218
+};
+
+// The flat engine steps through every iteration of the idle loops that the
+// table engine skips.
+static void test_run_should_fast_forward_idle_loops_like_stepping_through_them() {
+	uint16_t ticks[] = { 1, 2, 3, 10 };
+	uint8_t waits[] = { 0x01, 0x09 };
+
+	for (size_t tick = 0; tick < sizeof(ticks) / sizeof(ticks[0]); tick++) {
+		for (size_t wait = 0; wait < sizeof(waits) / sizeof(waits[0]); wait++) {
+			for (uint8_t pressed = 0; pressed < 2; pressed++) {
+				for (uint32_t count = 0; count < 300; count += 7) {
+					Chip8* a = create();
+					Chip8* b = create();
+					memcpy(&a->memory[0x200], idle_test_program, sizeof(idle_test_program));
+					memcpy(&b->memory[0x200], idle_test_program, sizeof(idle_test_program));
+					a->memory[0x211] = waits[wait];
+					b->memory[0x211] = waits[wait];
+					a->instructions_per_tick = ticks[tick];
+					b->instructions_per_tick = ticks[tick];
+					a->keypad[0] = pressed;
+					b->keypad[0] = pressed;
+					b->engine = CHIP8_ENGINE_FLAT;
+
+					run(a, count / 2);
+					run(a, count - count / 2);
+					run(b, count);
+
+					assert_same_state(a, b);
+
+					destroy(a);
+					destroy(b);
+				}
+			}
+		}
+	}
+}
+
+static void test_run_should_fast_forward_a_jump_to_itself() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x12;
+	a->memory[0x201] = 0x00;
+	a->delay_timer = 0x10;
+
+	run(a, 0xffffffff);
+
+	assert_int_equal(a->pc, 0x200);
+	assert_int_equal(a->instruction_count, 0xffffffff);
+	assert_int_equal(a->delay_timer, 0x00);
+
+	destroy(a);
+}
+
+static void test_run_should_wait_for_a_key_on_every_engine() {
+	Chip8Engine engines[] = { CHIP8_ENGINE_TABLE, CHIP8_ENGINE_FLAT, CHIP8_ENGINE_THREADED, CHIP8_ENGINE_JIT };
+
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		Chip8* a = create();
+		a->memory[0x200] = 0xf3;
+		a->memory[0x201] = 0x0a;
+		a->memory[0x202] = 0x73;
+		a->memory[0x203] = 0x01;
+		a->memory[0x204] = 0x12;
+		a->memory[0x205] = 0x04;
+		a->delay_timer = 0xc8;
+		a->engine = engines[i];
+
+		run(a, 1);
+		run(a, 999);
+
+		assert_int_equal(a->pc, 0x200);
+		assert_int_equal(a->opcode, 0xf30a);
+		assert_true(a->waiting_for_key);
+		assert_int_equal(a->instruction_count, 1000);
+		assert_int_equal(a->delay_timer, 0x64);
+
+		a->keypad[0x5] = 1;
+		run(a, 2);
+
+		assert_int_equal(a->registers[0x3], 0x06);
+		assert_int_equal(a->pc, 0x204);
+		assert_false(a->waiting_for_key);
+
+		destroy(a);
+	}
+}
+
+static void test_is_halted_should_only_be_true_on_a_jump_to_itself() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x12;
+	a->memory[0x201] = 0x02;
+	a->memory[0x202] = 0x12;
+	a->memory[0x203] = 0x02;
+
+	assert_false(is_halted(a));
+
+	run(a, 1);
+
+	assert_true(is_halted(a));
+
+	destroy(a);
+}
+
+static void test_run_flat_engine_should_match_table_engine() {
+	for (uint32_t count = 0; count < 160; count++) {
+		Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, count);
+		Chip8* b = run_engine_test_program(CHIP8_ENGINE_FLAT, count);
+
+		assert_same_state(a, b);
+
+		destroy(a);
+		destroy(b);
+	}
+}
+
+static void test_run_flat_engine_should_skip_invalid_opcodes() {
+	Chip8* a = create();
+	a->memory[0x200] = 0x01;
+	a->memory[0x201] = 0x23;
+	a->memory[0x202] = 0x6a;
+	a->memory[0x203] = 0x42;
+	a->engine = CHIP8_ENGINE_FLAT;
+
+	run(a, 2);
+
+	assert_int_equal(a->registers[0xa], 0x42);
+	assert_int_equal(a->pc, 0x204);
+	assert_int_equal(a->instruction_count, 2);
+
+	destroy(a);
+}
+
+#define LOCKSTEP_TEST_LANES 37
+
+// Every lane starts from the memory of template, with its own registers, keys
+// and random seed so that the lanes diverge.
+static void assert_lockstep_matches_cycle(Chip8* template, uint32_t count) {
+	Chip8Lockstep* lockstep = create_lockstep(LOCKSTEP_TEST_LANES);
+	Chip8* chips[LOCKSTEP_TEST_LANES];
+
+	assert_non_null(lockstep);
+
+	for (uint32_t lane = 0; lane < LOCKSTEP_TEST_LANES; lane++) {
+		chips[lane] = create();
+		memcpy(chips[lane]->memory, template->memory, sizeof(template->memory));
+		seed_random(chips[lane], lane);
+
+		my_cute_srand(lane);
+		for (uint8_t i = 0; i < CHIP8_REGISTER_COUNT; i++) {
+			chips[lane]->registers[i] = my_cute_rand();
+		}
+		chips[lane]->keypad[lane % CHIP8_KEYPAD_SIZE] = lane % 3 ? 0x01 : 0x00;
+
+		lockstep_load(lockstep, lane, chips[lane]);
+	}
+
+	run_lockstep(lockstep, count);
+
+	for (uint32_t lane = 0; lane < LOCKSTEP_TEST_LANES; lane++) {
+		Chip8* b = create();
+
+		run(chips[lane], count);
+		lockstep_store(lockstep, lane, b);
+
+		assert_same_state(chips[lane], b);
+
+		destroy(chips[lane]);
+		destroy(b);
+	}
+
+	lockstep_destroy(lockstep);
+}
+
+static void test_run_lockstep_should_match_cycle() {
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], engine_test_program, sizeof(engine_test_program));
+	memcpy(&a->memory[0x240], engine_test_subroutine, sizeof(engine_test_subroutine));
+
+	for (uint32_t count = 0; count < 400; count += 19) {
+		assert_lockstep_matches_cycle(a, count);
+	}
+
+	destroy(a);
+}
+
+// Every flag is folded into VA to VD so that a wrong one shows in the end state.
+static void test_run_lockstep_should_match_cycle_on_alu_instructions_with_vf_operands() {
+	uint8_t program[] = {
+		0x80, 0x14, // 0x200: ADD V0, V1
+		0x8a, 0xf3, // 0x202: XOR VA, VF
+		0x8f, 0xf4, // 0x204: ADD VF, VF
+		0x8b, 0xf3, // 0x206: XOR VB, VF
+		0x8f, 0x05, // 0x208: SUB VF, V0
+		0x8c, 0xf3, // 0x20a: XOR VC, VF
+		0x81, 0xf5, // 0x20c: SUB V1, VF
+		0x8d, 0xf3, // 0x20e: XOR VD, VF
+		0x8f, 0xf6, // 0x210: SHR VF
+		0x8a, 0xf3, // 0x212: XOR VA, VF
+		0x82, 0xf7, // 0x214: SUBN V2, VF
+		0x8b, 0xf3, // 0x216: XOR VB, VF
+		0x8f, 0x27, // 0x218: SUBN VF, V2
+		0x8c, 0xf3, // 0x21a: XOR VC, VF
+		0x8f, 0x0e, // 0x21c: SHL VF
+		0x8d, 0xf3, // 0x21e: XOR VD, VF
+		0x83, 0x0e, // 0x220: SHL V3
+		0x8a, 0xf3, // 0x222: XOR VA, VF
+		0x84, 0x36, // 0x224: SHR V4
+		0x8b, 0xf3, // 0x226: XOR VB, VF
+		0x6e, 0x00, // 0x228: LD VE, 0x00
+		0x85, 0xe4, // 0x22a: ADD V5, VE
+		0x8c, 0xf3, // 0x22c: XOR VC, VF
+		0x89, 0x95, // 0x22e: SUB V9, V9
+		0x8d, 0xf3, // 0x230: XOR VD, VF
+		0x7f, 0x11, // 0x232: ADD VF, 0x11
+		0x85, 0x23, // 0x234: XOR V5, V2
+		0x86, 0x51, // 0x236: OR V6, V5
+		0x87, 0x62, // 0x238: AND V7, V6
+		0x88, 0x70, // 0x23a: LD V8, V7
+		0x30, 0x01, // 0x23c: SE V0, 0x01
+		0x6f, 0x09, // 0x23e: LD VF, 0x09
+		0x12, 0x00, // 0x240: JP 0x200
+	};
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], program, sizeof(program));
+
+	assert_lockstep_matches_cycle(a, 500);
+
+	destroy(a);
+}
+
+static void test_run_lockstep_should_match_cycle_on_key_instructions() {
+	uint8_t program[] = {
+		0x61, 0x00, // 0x200: LD V1, 0x00
+		0xf1, 0x0a, // 0x202: LD V1, K
+		0xe1, 0x9e, // 0x204: SKP V1
+		0x72, 0x01, // 0x206: ADD V2, 0x01
+		0xe1, 0xa1, // 0x208: SKNP V1
+		0x73, 0x01, // 0x20a: ADD V3, 0x01
+		0x12, 0x02, // 0x20c: JP 0x202
+	};
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], program, sizeof(program));
+
+	assert_lockstep_matches_cycle(a, 100);
+
+	destroy(a);
+}
+
+static void test_run_jit_engine_should_execute_code_modified_by_fx55() {
+	uint8_t program[] = {
+		0x6a, 0x01, // 0x200: LD VA, 0x01
+		0x3b, 0x01, // 0x202: SE VB, 0x01
+		0x12, 0x08, // 0x204: JP 0x208
+		0x12, 0x06, // 0x206: JP 0x206
+		0x7b, 0x01, // 0x208: ADD VB, 0x01
+		0x60, 0x6a, // 0x20a: LD V0, 0x6a
+		0x61, 0x07, // 0x20c: LD V1, 0x07
+		0xa2, 0x00, // 0x20e: LD I, 0x200
+		0xf1, 0x55, // 0x210: LD [I], V1
+		0x12, 0x00, // 0x212: JP 0x200
+	};
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], program, sizeof(program));
+	a->engine = CHIP8_ENGINE_JIT;
+
+	run(a, 32);
+
+	assert_int_equal(a->registers[0xa], 0x07);
+	assert_int_equal(a->pc, 0x206);
+
+	destroy(a);
+}
+
+static void test_run_flat_engine_should_execute_code_modified_by_fx55() {
+	uint8_t program[] = {
+		0x6a, 0x01, // 0x200: LD VA, 0x01
+		0x3b, 0x01, // 0x202: SE VB, 0x01
+		0x12, 0x08, // 0x204: JP 0x208
+		0x12, 0x06, // 0x206: JP 0x206
+		0x7b, 0x01, // 0x208: ADD VB, 0x01
+		0x60, 0x6a, // 0x20a: LD V0, 0x6a
+		0x61, 0x07, // 0x20c: LD V1, 0x07
+		0xa2, 0x00, // 0x20e: LD I, 0x200
+		0xf1, 0x55, // 0x210: LD [I], V1
+		0x12, 0x00, // 0x212: JP 0x200
+	};
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], program, sizeof(program));
+	a->engine = CHIP8_ENGINE_FLAT;
+
+	run(a, 32);
+
+	assert_int_equal(a->registers[0xa], 0x07);
+	assert_int_equal(a->pc, 0x206);
+
+	destroy(a);
+}
+
+static void test_frames_take_should_return_null_until_a_frame_is_published() {
+	static Chip8Frames frames;
+	frames_init(&frames);
+
+	assert_null(frames_take(&frames));
+
+	frames_back(&frames)->dirty_rows = 0x00000003;
+	frames_publish(&frames);
+
+	Chip8Frame* frame = frames_take(&frames);
+	assert_non_null(frame);
+	assert_int_equal(frame->sequence, 1);
+	assert_int_equal(frame->dirty_rows, 0x00000003);
+	assert_null(frames_take(&frames));
+}
+
+static void test_frames_take_should_redraw_every_row_after_a_skipped_frame() {
+	static Chip8Frames frames;
+	frames_init(&frames);
+
+	for (uint32_t i = 0; i < 3; i++) {
+		frames_back(&frames)->dirty_rows = 0x00000001 << i;
+		frames_publish(&frames);
+	}
+
+	Chip8Frame* frame = frames_take(&frames);
+	assert_int_equal(frame->sequence, 3);
+	assert_int_equal(frame->dirty_rows, 0xffffffff);
+}
+
+static void test_frames_back_should_never_be_the_taken_frame() {
+	static Chip8Frames frames;
+	frames_init(&frames);
+
+	frames_publish(&frames);
+	Chip8Frame* taken = frames_take(&frames);
+
+	for (uint32_t i = 0; i < 8; i++) {
+		assert_ptr_not_equal(frames_back(&frames), taken);
+		frames_publish(&frames);
+	}
+}
+
+static void test_publish_video_should_move_the_dirty_rows_to_the_frame() {
+	static Chip8Frames frames;
+	frames_init(&frames);
+	Chip8* a = create();
+	a->video[0x3] = 0x8000000000000000;
+	a->dirty_rows = 0x00000008;
+
+	publish_video(&frames, a);
+
+	Chip8Frame* frame = frames_take(&frames);
+	assert_int_equal(frame->dirty_rows, 0x00000008);
+	assert_int_equal(frame->pixels[0x3 * CHIP8_SCREEN_WIDTH], CHIP8_PIXEL_ON);
+	assert_int_equal(frame->pixels[0x3 * CHIP8_SCREEN_WIDTH + 1], 0);
+	assert_int_equal(a->dirty_rows, 0);
+
+	destroy(a);
+}
+
+#define FRAMES_TEST_COUNT 20000
+
+static void* publish_test_frames(void* argument) {
+	Chip8Frames* frames = argument;
+
+	for (uint32_t i = 1; i <= FRAMES_TEST_COUNT; i++) {
+		Chip8Frame* frame = frames_back(frames);
+		for (uint32_t pixel = 0; pixel < CHIP8_PIXEL_COUNT; pixel++) {
+			frame->pixels[pixel] = i;
+		}
+		frames_publish(frames);
+	}
+
+	return NULL;
+}
+
+// A torn frame would mix the pixels of two publications.
+static void test_frames_should_hand_whole_frames_to_another_thread() {
+	static Chip8Frames frames;
+	frames_init(&frames);
+	pthread_t writer;
+	uint64_t last = 0;
+
+	pthread_create(&writer, NULL, publish_test_frames, &frames);
+
+	while (last < FRAMES_TEST_COUNT) {
+		Chip8Frame* frame = frames_take(&frames);
+		if (!frame) {
+			continue;
+		}
+
+		assert_true(frame->sequence > last);
+		for (uint32_t pixel = 0; pixel < CHIP8_PIXEL_COUNT; pixel++) {
+			assert_int_equal(frame->pixels[pixel], frame->sequence);
+		}
+		last = frame->sequence;
+	}
+
+	pthread_join(writer, NULL);
+}
+
+static void make_movie_path(char* path) {
+	int fd = mkstemp(path);
+
+	assert_true(fd >= 0);
+	close(fd);
+}
+
+static void test_movie_record_should_only_add_keypad_changes() {
+	Chip8* a = create();
+	Chip8Movie* movie = create_movie(42, CHIP8_INSTRUCTIONS_PER_TICK);
+
+	assert_int_equal(movie_record(movie, a, 0), 0);
+	assert_int_equal(movie->event_count, 0);
+
+	a->instruction_count = 30;
+	a->keypad[0x3] = 0xff;
+	a->keypad[0xc] = 1;
+	movie_record(movie, a, 3);
+	a->instruction_count = 40;
+	movie_record(movie, a, 4);
+
+	assert_int_equal(movie->event_count, 1);
+	assert_int_equal(movie->events[0].instruction, 30);
+	assert_int_equal(movie->events[0].frame, 3);
+	assert_int_equal(movie->events[0].keys, 0x1008);
+
+	movie_destroy(movie);
+	destroy(a);
+}
+
+static void test_movie_add_should_reject_events_out_of_order() {
+	Chip8Movie* movie = create_movie(42, CHIP8_INSTRUCTIONS_PER_TICK);
+
+	assert_int_equal(movie_add(movie, (Chip8MovieEvent){ 100, 10, 0x1 }), 0);
+	assert_int_equal(movie_add(movie, (Chip8MovieEvent){ 100, 10, 0x3 }), 0);
+	assert_int_equal(movie_add(movie, (Chip8MovieEvent){ 99, 10, 0x0 }), -1);
+	assert_int_equal(movie_add(movie, (Chip8MovieEvent){ 101, 9, 0x0 }), -1);
+	assert_int_equal(movie->event_count, 2);
+
+	movie_destroy(movie);
+}
+
+static void test_save_movie_should_round_trip_through_load_movie() {
+	char path[] = "/tmp/chip8-movie-XXXXXX";
+	make_movie_path(path);
+	Chip8Movie* movie = create_movie(0x0123456789abcdef, 17);
+
+	for (uint64_t i = 0; i < 200; i++) {
+		movie_add(movie, (Chip8MovieEvent){ i * i * i * i, i * 3, i * 0x0101 });
+	}
+	assert_int_equal(save_movie(movie, path), 0);
+
+	Chip8Movie* loaded = load_movie(path);
+
+	assert_non_null(loaded);
+	assert_int_equal(loaded->seed, movie->seed);
+	assert_int_equal(loaded->instructions_per_tick, 17);
+	assert_int_equal(loaded->event_count, movie->event_count);
+	assert_memory_equal(loaded->events, movie->events, movie->event_count * sizeof(Chip8MovieEvent));
+
+	movie_destroy(loaded);
+	movie_destroy(movie);
+	unlink(path);
+}
+
+static void test_load_movie_should_fail_on_a_truncated_or_foreign_file() {
+	char path[] = "/tmp/chip8-movie-XXXXXX";
+	make_movie_path(path);
+	Chip8Movie* movie = create_movie(42, CHIP8_INSTRUCTIONS_PER_TICK);
+	movie_add(movie, (Chip8MovieEvent){ 1000, 100, 0x10 });
+	movie_add(movie, (Chip8MovieEvent){ 2000, 200, 0x00 });
+	save_movie(movie, path);
+
+	assert_int_equal(truncate(path, 20), 0);
+	assert_null(load_movie(path));
+
+	FILE* f = fopen(path, "wb");
+	fputs("not a movie at all", f);
+	fclose(f);
+	assert_null(load_movie(path));
+
+	// A movie that never runs an instruction would freeze on replay.
+	Chip8Movie* idle = create_movie(42, 0);
+	save_movie(idle, path);
+	assert_null(load_movie(path));
+	movie_destroy(idle);
+
+	assert_null(load_movie("does-not-exist.c8m"));
+
+	movie_destroy(movie);
+	unlink(path);
+}
+
+// Draws a random digit wherever the keys it polls moved it, and waits on
+// random delays.
+static const uint8_t movie_test_program[] = {
+	0x64, 0x0f, 0xc2, 0xff, 0xe1, 0x9e, 0x12, 0x0a, 0x73, 0x01, 0x71, 0x01,
+	0x81, 0x42, 0xf2, 0x29, 0xd3, 0x15, 0xf0, 0x07, 0x30, 0x00, 0x12, 0x02,
+	0xf2, 0x15, 0x12, 0x02,
+};
+
+static Chip8* create_movie_test_chip(Chip8Engine engine, uint64_t seed, uint16_t instructions_per_tick) {
+	Chip8* a = create();
+	memcpy(&a->memory[0x200], movie_test_program, sizeof(movie_test_program));
+	seed_random(a, seed);
+	a->instructions_per_tick = instructions_per_tick;
+	a->engine = engine;
+
+	return a;
+}
+
+static void test_load_movie_should_replay_a_recording_on_every_engine() {
+	Chip8Engine engines[] = { CHIP8_ENGINE_TABLE, CHIP8_ENGINE_FLAT, CHIP8_ENGINE_THREADED, CHIP8_ENGINE_JIT };
+	const uint16_t instructions_per_frame = 7;
+	char path[] = "/tmp/chip8-movie-XXXXXX";
+	make_movie_path(path);
+
+	Chip8* recorded = create_movie_test_chip(CHIP8_ENGINE_TABLE, 1234, instructions_per_frame);
+	Chip8Movie* movie = create_movie(1234, instructions_per_frame);
+	my_cute_srand(7);
+	for (uint32_t frame = 0; frame < 600; frame++) {
+		if (my_cute_rand() < 40) {
+			uint8_t key = my_cute_rand() & 0xf;
+			recorded->keypad[key] = recorded->keypad[key] ? 0 : 0xff;
+		}
+		movie_record(movie, recorded, frame);
+		run(recorded, instructions_per_frame);
+	}
+	assert_true(movie->event_count > 10);
+	save_movie(movie, path);
+
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		Chip8Movie* loaded = load_movie(path);
+		Chip8* replayed = create_movie_test_chip(engines[i], loaded->seed, loaded->instructions_per_tick);
+
+		// Headless, so only stop where the keypad changes.
+		size_t event = 0;
+		while (replayed->instruction_count < recorded->instruction_count) {
+			while (event < loaded->event_count && loaded->events[event].instruction <= replayed->instruction_count) {
+				movie_apply(&loaded->events[event++], replayed);
+			}
+			uint64_t until = event < loaded->event_count ? loaded->events[event].instruction : recorded->instruction_count;
+			run(replayed, until - replayed->instruction_count);
+		}
+
+		assert_same_state(recorded, replayed);
+		assert_memory_equal(recorded->keypad, replayed->keypad, sizeof(recorded->keypad));
+		assert_int_equal(recorded->random_state, replayed->random_state);
+
+		destroy(replayed);
+		movie_destroy(loaded);
+	}
+
+	destroy(recorded);
+	movie_destroy(movie);
+	unlink(path);
+}
+
+static void test_load_rom_should_return_an_error_if_the_rom_does_not_exist() {
+	Chip8* a = create();
+
+	assert_int_equal(load_rom(a, "does-not-exist.ch8"), CHIP8_ERROR_OPEN_FILE);
+	assert_int_equal(a->pc, 0x200);
+
+	destroy(a);
+}
+
+static void test_load_rom_should_record_the_size_of_the_rom() {
+	char path[] = "/tmp/chip8-rom-XXXXXX";
+	make_movie_path(path);
+	const uint8_t rom[] = { 0x60, 0x05, 0x12, 0x00, 0xab };
+	FILE* f = fopen(path, "wb");
+	fwrite(rom, 1, sizeof(rom), f);
+	fclose(f);
+	Chip8* a = create();
+
+	assert_int_equal(load_rom(a, path), CHIP8_OK);
+	assert_int_equal(a->rom_size, sizeof(rom));
+	assert_memory_equal(&a->memory[0x200], rom, sizeof(rom));
+
+	destroy(a);
+	unlink(path);
+}
+
+static void test_dump_memory_to_file_should_return_an_error_if_the_file_cannot_be_created() {
+	Chip8* a = create();
+
+	assert_int_equal(dump_memory_to_file(a, "does-not-exist/memory.bin"), CHIP8_ERROR_OPEN_FILE);
+
+	destroy(a);
+}
+
+static void test_chip8_strerror_should_describe_every_error() {
+	Chip8Error errors[] = {
+		CHIP8_OK, CHIP8_ERROR_OUT_OF_MEMORY, CHIP8_ERROR_OPEN_FILE, CHIP8_ERROR_READ_FILE, CHIP8_ERROR_WRITE_FILE
+	};
+
+	for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+		for (size_t j = 0; j < i; j++) {
+			assert_string_not_equal(chip8_strerror(errors[i]), chip8_strerror(errors[j]));
+		}
+	}
+	assert_string_equal(chip8_strerror((Chip8Error) 42), "unknown error");
+}
+
+#define THREADED_CHIPS_COUNT 8
+
+static void* run_engine_test_program_on_a_thread(void* engine) {
+	return run_engine_test_program(*(Chip8Engine*) engine, 100000);
+}
+
+static void test_run_should_not_share_state_between_chips_on_different_threads() {
+	Chip8Engine engines[THREADED_CHIPS_COUNT];
+	pthread_t threads[THREADED_CHIPS_COUNT];
+	Chip8* expected[] = {
+		run_engine_test_program(CHIP8_ENGINE_TABLE, 100000),
+		run_engine_test_program(CHIP8_ENGINE_JIT, 100000)
+	};
+
+	for (int i = 0; i < THREADED_CHIPS_COUNT; i++) {
+		engines[i] = i % 2 ? CHIP8_ENGINE_JIT : CHIP8_ENGINE_TABLE;
+		pthread_create(&threads[i], NULL, run_engine_test_program_on_a_thread, &engines[i]);
+	}
+	for (int i = 0; i < THREADED_CHIPS_COUNT; i++) {
+		void* result;
+		pthread_join(threads[i], &result);
+
+		assert_same_state(expected[i % 2], result);
+
+		destroy(result);
+	}
+
+	destroy(expected[0]);
+	destroy(expected[1]);
+}
+
+static void test_chip8_reset_should_restore_the_pristine_chip() {
+	Chip8* pristine = run_engine_test_program(CHIP8_ENGINE_TABLE, 0);
+	Chip8* expected = run_engine_test_program(CHIP8_ENGINE_TABLE, 160);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_JIT, 300);
+
+	chip8_reset(a, pristine);
+	a->engine = CHIP8_ENGINE_JIT;
+	run(a, 160);
+
+	assert_same_state(expected, a);
+	assert_int_equal(a->random_state, expected->random_state);
+
+	destroy(pristine);
+	destroy(expected);
+	destroy(a);
+}
+
+static void test_chip8_reset_should_keep_the_decoded_instructions_of_unchanged_pages() {
+	Chip8* pristine = create();
+	pristine->memory[0x200] = 0x60;
+	pristine->memory[0x201] = 0x01;
+	pristine->memory[0x300] = 0x61;
+	pristine->memory[0x301] = 0x02;
+	Chip8* a = create();
+	chip8_reset(a, pristine);
+	a->pc = 0x200;
+	cycle(a);
+	a->pc = 0x300;
+	cycle(a);
+	a->memory[0x3ff] = 0xff;
+
+	chip8_reset(a, pristine);
+
+	assert_non_null(a->decoded[0x200].handler);
+	assert_null(a->decoded[0x300].handler);
+	assert_int_equal(a->memory[0x3ff], 0x00);
+	assert_int_equal(a->pc, 0x200);
+
+	destroy(pristine);
+	destroy(a);
+}
+
+static void test_chip8_clone_should_branch_like_the_parent() {
+	Chip8* parent = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	Chip8* child = create();
+
+	chip8_clone(child, parent);
+	assert_memory_equal(child, parent, CHIP8_MACHINE_SIZE);
+
+	child->engine = CHIP8_ENGINE_JIT;
+	run(child, 300);
+	chip8_clone(child, parent);
+	assert_memory_equal(child, parent, CHIP8_MACHINE_SIZE);
+
+	run(parent, 60);
+	run(child, 60);
+	assert_same_state(parent, child);
+	assert_int_equal(child->random_state, parent->random_state);
+
+	destroy(parent);
+	destroy(child);
+}
+
+static void test_chip8_clone_should_copy_only_the_pages_written_since_the_last_clone() {
+	Chip8* parent = create();
+	parent->memory[0x200] = 0x60;
+	parent->memory[0x201] = 0x01;
+	parent->memory[0x300] = 0x61;
+	parent->memory[0x301] = 0x02;
+	Chip8* child = create();
+	chip8_clone(child, parent);
+	child->pc = 0x200;
+	cycle(child);
+	child->pc = 0x300;
+	cycle(child);
+
+	parent->memory[0x301] = 0x03;
+	invalidate_decoded(parent, 0x301, 1);
+	child->memory[0x410] = 0xaa;
+	invalidate_decoded(child, 0x410, 1);
+	// Not written through invalidate_decoded(), so not seen: the page is
+	// skipped instead of compared.
+	child->memory[0x600] = 0xbb;
+
+	chip8_clone(child, parent);
+
+	assert_non_null(child->decoded[0x200].handler);
+	assert_null(child->decoded[0x300].handler);
+	assert_int_equal(child->memory[0x301], 0x03);
+	assert_int_equal(child->memory[0x410], 0x00);
+	assert_int_equal(child->memory[0x600], 0xbb);
+
+	child->pc = 0x300;
+	cycle(child);
+	assert_int_equal(child->registers[0x1], 0x03);
+
+	destroy(parent);
+	destroy(child);
+}
+
+static void test_chip8_clone_should_copy_everything_from_another_parent() {
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	Chip8* b = create();
+	b->memory[0x300] = 0x12;
+	Chip8* child = create();
+
+	chip8_clone(child, a);
+	chip8_clone(child, b);
+
+	assert_memory_equal(child, b, CHIP8_MACHINE_SIZE);
+
+	destroy(a);
+	destroy(b);
+	destroy(child);
+}
+
+static void test_pool_acquire_should_hand_out_each_chip_once_until_it_is_released() {
+	Chip8* pristine = create();
+	Chip8Pool* pool = create_pool(3, 0);
+	Chip8* chips[3];
+
+	for (int i = 0; i < 3; i++) {
+		chips[i] = pool_acquire(pool, pristine);
+		assert_non_null(chips[i]);
+		assert_int_equal((uintptr_t) chips[i] % 64, 0);
+		for (int j = 0; j < i; j++) {
+			assert_ptr_not_equal(chips[i], chips[j]);
+		}
+	}
+	assert_null(pool_acquire(pool, pristine));
+
+	pool_release(pool, chips[1]);
+
+	assert_ptr_equal(pool_acquire(pool, pristine), chips[1]);
+
+	pool_destroy(pool);
+	destroy(pristine);
+}
+
+static void test_pool_acquire_should_reset_a_released_chip() {
+	Chip8* pristine = run_engine_test_program(CHIP8_ENGINE_TABLE, 0);
+	Chip8* expected = run_engine_test_program(CHIP8_ENGINE_TABLE, 160);
+	Chip8Pool* pool = create_pool(1, CHIP8_POOL_HUGEPAGES);
+
+	for (int i = 0; i < 3; i++) {
+		Chip8* a = pool_acquire(pool, pristine);
+		run(a, 160);
+
+		assert_same_state(expected, a);
+
+		// Leave a decoded instruction the ROM does not have.
+		a->memory[0x240] ^= 0xff;
+		invalidate_decoded(a, 0x240, 1);
+		a->pc = 0x240;
+		cycle(a);
+		pool_release(pool, a);
+	}
+
+	pool_destroy(pool);
+	destroy(pristine);
+	destroy(expected);
+}
+
+static void test_chip8_load_state_should_resume_like_an_uninterrupted_run() {
+	Chip8* expected = run_engine_test_program(CHIP8_ENGINE_TABLE, 160);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	static Chip8State state;
+
+	chip8_save_state(a, &state);
+	run(a, 200);
+	chip8_load_state(a, &state);
+	a->engine = CHIP8_ENGINE_JIT;
+	run(a, 60);
+
+	assert_same_state(expected, a);
+	assert_int_equal(a->random_state, expected->random_state);
+
+	destroy(expected);
+	destroy(a);
+}
+
+static void test_chip8_save_state_file_should_round_trip_through_chip8_load_state_file() {
+	char path[] = "/tmp/chip8-state-XXXXXX";
+	make_movie_path(path);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	a->keypad[0x7] = 0xff;
+	Chip8* b = create();
+
+	assert_int_equal(chip8_save_state_file(a, path), CHIP8_OK);
+	assert_int_equal(chip8_load_state_file(b, path), CHIP8_OK);
+
+	assert_same_state(a, b);
+	assert_memory_equal(a->keypad, b->keypad, sizeof(a->keypad));
+	assert_int_equal(a->random_state, b->random_state);
+
+	struct stat info;
+	stat(path, &info);
+	assert_int_equal(info.st_size % CHIP8_STATE_ALIGNMENT, 0);
+
+	destroy(a);
+	destroy(b);
+	unlink(path);
+}
+
+static void test_chip8_load_state_file_should_leave_the_chip_alone_on_a_foreign_or_truncated_file() {
+	char path[] = "/tmp/chip8-state-XXXXXX";
+	make_movie_path(path);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	Chip8* b = run_engine_test_program(CHIP8_ENGINE_TABLE, 10);
+	Chip8* expected = run_engine_test_program(CHIP8_ENGINE_TABLE, 10);
+	chip8_save_state_file(a, path);
+
+	assert_int_equal(truncate(path, CHIP8_STATE_ALIGNMENT + 100), 0);
+	assert_int_equal(chip8_load_state_file(b, path), CHIP8_ERROR_READ_FILE);
+
+	chip8_save_state_file(a, path);
+	FILE* f = fopen(path, "r+b");
+	fseek(f, offsetof(Chip8StateHeader, version), SEEK_SET);
+	fputc(CHIP8_STATE_VERSION + 1, f);
+	fclose(f);
+	assert_int_equal(chip8_load_state_file(b, path), CHIP8_ERROR_READ_FILE);
+
+	assert_int_equal(chip8_load_state_file(b, "does-not-exist.c8s"), CHIP8_ERROR_OPEN_FILE);
+
+	assert_same_state(expected, b);
+
+	destroy(a);
+	destroy(b);
+	destroy(expected);
+	unlink(path);
+}
+
+static void test_chip8_map_state_file_should_start_where_the_saved_chip_was() {
+	char path[] = "/tmp/chip8-state-XXXXXX";
+	make_movie_path(path);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	Chip8* b;
+	chip8_save_state_file(a, path);
+
+	assert_int_equal(chip8_map_state_file(&b, path), CHIP8_OK);
+	assert_int_equal((uintptr_t) b % CHIP8_STATE_ALIGNMENT, 0);
+	a->dirty_rows = 0xffffffff;
+	assert_memory_equal(a, b, CHIP8_MACHINE_SIZE);
+
+	run(a, 60);
+	b->memory[0x300] = 0x42;
+	invalidate_decoded(b, 0x300, 1);
+	a->memory[0x300] = 0x42;
+	invalidate_decoded(a, 0x300, 1);
+	run(b, 60);
+	assert_same_state(a, b);
+
+	// Writes stay in the mapping.
+	Chip8* c;
+	assert_int_equal(chip8_map_state_file(&c, path), CHIP8_OK);
+	assert_int_equal(c->memory[0x300], 0);
+
+	chip8_unmap_state_file(b);
+	chip8_unmap_state_file(c);
+	destroy(a);
+	unlink(path);
+}
+
+static void test_chip8_map_state_file_should_publish_the_whole_screen_first() {
+	char path[] = "/tmp/chip8-state-XXXXXX";
+	make_movie_path(path);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 100);
+	Chip8Frames frames;
+	frames_init(&frames);
+	// A frontend saves on exit, after showing the last frame.
+	publish_video(&frames, a);
+	chip8_save_state_file(a, path);
+	Chip8* b;
+
+	assert_int_equal(chip8_map_state_file(&b, path), CHIP8_OK);
+	assert_int_equal(b->dirty_rows, 0xffffffff);
+
+	frames_init(&frames);
+	publish_video(&frames, b);
+	Chip8Frame* frame = frames_take(&frames);
+	assert_non_null(frame);
+	assert_int_equal(frame->dirty_rows, 0xffffffff);
+	uint32_t pixels[CHIP8_PIXEL_COUNT];
+	expand_video(a, pixels);
+	assert_memory_equal(frame->pixels, pixels, sizeof(pixels));
+
+	chip8_unmap_state_file(b);
+	destroy(a);
+	unlink(path);
+}
+
+static void test_chip8_map_state_file_should_fail_on_a_missing_or_foreign_file() {
+	char path[] = "/tmp/chip8-state-XXXXXX";
+	make_movie_path(path);
+	Chip8* a = create();
+	dump_memory_to_file(a, path);
+	Chip8* b = a;
+
+	assert_int_equal(chip8_map_state_file(&b, path), CHIP8_ERROR_READ_FILE);
+	assert_null(b);
+	assert_int_equal(chip8_map_state_file(&b, "does-not-exist.c8s"), CHIP8_ERROR_OPEN_FILE);
+	assert_null(b);
+
+	destroy(a);
+	unlink(path);
+}
+
+#define REWIND_TEST_FRAMES 50
+
+static void test_rewind_pop_should_go_back_through_every_pushed_frame() {
+	static Chip8State states[REWIND_TEST_FRAMES];
+	Chip8Rewind* history = create_rewind(64 * 1024);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 0);
+
+	for (int frame = 0; frame < REWIND_TEST_FRAMES; frame++) {
+		run(a, 7);
+		a->keypad[frame % CHIP8_KEYPAD_SIZE] ^= 0xff;
+		chip8_save_state(a, &states[frame]);
+		rewind_push(history, a);
+	}
+
+	for (int frame = REWIND_TEST_FRAMES - 2; frame >= 0; frame--) {
+		assert_int_equal(rewind_pop(history, a), 0);
+		assert_memory_equal(a, states[frame].machine, CHIP8_MACHINE_SIZE);
+	}
+	assert_int_equal(rewind_pop(history, a), -1);
+	assert_memory_equal(a, states[0].machine, CHIP8_MACHINE_SIZE);
+
+	rewind_destroy(history);
+	destroy(a);
+}
+
+static void test_rewind_push_should_drop_the_oldest_frames_past_the_budget() {
+	static Chip8State states[REWIND_TEST_FRAMES];
+	Chip8Rewind* history = create_rewind(300);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 0);
+
+	for (int frame = 0; frame < REWIND_TEST_FRAMES; frame++) {
+		run(a, 7);
+		chip8_save_state(a, &states[frame]);
+		rewind_push(history, a);
+		assert_true(history->used <= history->capacity);
+	}
+
+	uint32_t kept = history->frame_count;
+	assert_true(kept > 0);
+	assert_true(kept < REWIND_TEST_FRAMES - 1);
+
+	for (uint32_t i = 1; i <= kept; i++) {
+		assert_int_equal(rewind_pop(history, a), 0);
+		assert_memory_equal(a, states[REWIND_TEST_FRAMES - 1 - i].machine, CHIP8_MACHINE_SIZE);
+	}
+	assert_int_equal(rewind_pop(history, a), -1);
+
+	rewind_destroy(history);
+	destroy(a);
+}
+
+static void test_rewind_push_should_keep_a_minute_of_frames_under_a_megabyte() {
+	Chip8Rewind* history = create_rewind(1024 * 1024);
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, 0);
+
+	for (int frame = 0; frame < 60 * 60; frame++) {
+		run(a, a->instructions_per_tick);
+		rewind_push(history, a);
+	}
+
+	assert_int_equal(history->frame_count, 60 * 60 - 1);
+
+	rewind_destroy(history);
+	destroy(a);
+}
+
+static void test_load_aot_should_fail_if_library_does_not_exist() {
+	Chip8* a = create();
+
+	assert_int_equal(load_aot(a, "does-not-exist.so"), -1);
+	assert_null(a->aot);
+
+	destroy(a);
+}
+
+static void test_run_aot_engine_should_interpret_without_a_recompiled_rom() {
+	for (uint32_t count = 0; count < 160; count += 5) {
+		Chip8* a = run_engine_test_program(CHIP8_ENGINE_TABLE, count);
+		Chip8* b = run_engine_test_program(CHIP8_ENGINE_AOT, count);
+
+		assert_same_state(a, b);
+
+		destroy(a);
+		destroy(b);
+	}
+}
+
+static void test_run_should_tick_timers_once_per_instructions_per_tick() {
+	Chip8* a = create();
+	a->delay_timer = 5;
+	a->sound_timer = 1;
+
+	run(a, CHIP8_INSTRUCTIONS_PER_TICK - 1);
+
+	assert_int_equal(a->delay_timer, 5);
+	assert_int_equal(a->sound_timer, 1);
+
+	run(a, 1);
+
+	assert_int_equal(a->delay_timer, 4);
+	assert_int_equal(a->sound_timer, 0);
+
+	run(a, 10 * CHIP8_INSTRUCTIONS_PER_TICK);
+
+	assert_int_equal(a->delay_timer, 0);
+
+	destroy(a);
+}
+
+static void test_op_fx07_should_read_the_delay_timer_of_the_current_tick() {
+	Chip8* a = create();
+	a->instructions_per_tick = 4;
+	a->delay_timer = 9;
+	a->instruction_count = 9;
+	a->opcode = 0xf307;
+
+	op_fx07(a, operands_of(a));
+
+	assert_int_equal(a->registers[0x3], 7);
+	assert_int_equal(a->timers_updated_at, 8);
+
+	destroy(a);
+}
+
+static void test_run_should_execute_count_instructions() {
+	Chip8* a = run_engine_test_program(CHIP8_ENGINE_THREADED, 3);
+
+	assert_int_equal(a->pc, 0x206);
+	assert_int_equal(a->registers[0xc], 0xff);
+
+	destroy(a);
+}
+
 int main(void) {
 	srand(time(NULL));
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_op_00e0_should_fill_memory_with_zeroes),
+		cmocka_unit_test(test_op_00e0_should_mark_every_row_dirty),
 		cmocka_unit_test(test_op_00ee_should_set_the_pc_to_address_on_top_of_stack),
 		cmocka_unit_test(test_op_00ee_should_decrease_sp_by_one),
 		cmocka_unit_test(test_op_1nnn_should_set_the_pc_to_nnn),
 		cmocka_unit_test(test_op_2nnn_should_increment_the_sp),
 		cmocka_unit_test(test_op_2nnn_should_put_the_current_pc_on_the_top_of_the_stack),
+		cmocka_unit_test(test_op_2nnn_should_wrap_around_a_full_stack),
 		cmocka_unit_test(test_op_2nnn_should_set_the_pc_to_nnn),
 		cmocka_unit_test(test_op_3xkk_should_increment_pc_by_two_if_vx_and_kk_are_equal),
 		cmocka_unit_test(test_op_3xkk_should_maintain_pc_if_vx_and_kk_are_different),
@@ -888,15 +2500,23 @@ int main(void) {
 		cmocka_unit_test(test_op_cxkk_should_set_vx_to_kk_and_a_random_number_between_0_and_255),
 		cmocka_unit_test(test_op_cxkk_should_set_vx_to_zero_if_kk_is_zero),
 		cmocka_unit_test(test_op_cxkk_should_set_vx_to_kk_and_a_random_number),
+		cmocka_unit_test(test_generate_random_byte_should_repeat_for_the_same_seed),
+		cmocka_unit_test(test_generate_random_byte_should_differ_for_different_seeds),
+		cmocka_unit_test(test_cycle_should_use_the_chip_generator_for_cxkk),
 		cmocka_unit_test(test_op_dxyn_draws_sprite_in_position_defined_by_vx_and_vy),
 		cmocka_unit_test(test_op_dxyn_sets_vf_to_1_if_there_is_sprite_collision),
+		cmocka_unit_test(test_op_dxyn_wraps_sprite_around_the_screen),
+		cmocka_unit_test(test_op_dxyn_sets_vf_to_0_if_there_is_no_sprite_collision),
+		cmocka_unit_test(test_op_dxyn_should_mark_only_changed_rows_dirty),
+		cmocka_unit_test(test_expand_video_should_set_one_pixel_per_bit),
 		cmocka_unit_test(test_op_ex9e_should_increment_pc_if_key_with_the_value_of_vx_is_pressed),
+		cmocka_unit_test(test_op_ex9e_should_wrap_vx_around_the_keypad),
 		cmocka_unit_test(test_op_ex9e_should_not_increment_pc_if_key_with_the_value_of_vx_is_not_pressed),
 		cmocka_unit_test(test_op_exa1_should_not_increment_pc_if_key_with_the_value_of_vx_is_pressed),
 		cmocka_unit_test(test_op_exa1_should_increment_pc_if_key_with_the_value_of_vx_is_not_pressed),
 		cmocka_unit_test(test_op_fx07_should_set_vx_to_the_value_of_delay_timer),
 		cmocka_unit_test(test_op_fx0a_should_set_vx_to_the_value_of_the_key_pressed),
-		cmocka_unit_test(test_op_fx0a_should_increment_pc_if_no_key_is_pressed),
+		cmocka_unit_test(test_op_fx0a_should_wait_on_the_same_instruction_if_no_key_is_pressed),
 		cmocka_unit_test(test_op_fx15_should_set_delay_timer_to_the_value_of_vx),
 		cmocka_unit_test(test_op_fx18_should_set_sound_timer_to_the_value_of_vx),
 		cmocka_unit_test(test_op_fx1e_should_increment_index_by_the_value_of_vx),
@@ -904,6 +2524,68 @@ int main(void) {
 		cmocka_unit_test(test_op_fx33_should_store_bcd_representation_of_vx_in_memory_locations_i_i_plus_one_i_plus_two),
 		cmocka_unit_test(test_op_fx55_should_store_registers_v0_through_vx_in_memory_starting_at_location_i),
 		cmocka_unit_test(test_op_fx65_should_read_registers_v0_through_vx_from_memory_starting_at_location_i),
+		cmocka_unit_test(test_op_fx55_should_wrap_around_the_end_of_memory),
+		cmocka_unit_test(test_run_should_wrap_the_fetch_past_the_end_of_memory_on_every_engine),
+		cmocka_unit_test(test_identify_should_decode_every_instruction_whatever_its_operands),
+		cmocka_unit_test(test_identify_should_return_null_outside_the_instruction_set),
+		cmocka_unit_test(test_identify_should_match_exactly_one_instruction_per_opcode),
+		cmocka_unit_test(test_disassemble_should_fill_in_the_operands),
+		cmocka_unit_test(test_disassemble_should_write_unknown_opcodes_as_data),
+		cmocka_unit_test(test_disassemble_should_truncate_to_the_buffer_size),
+		cmocka_unit_test(test_cycle_should_execute_the_instruction_at_pc),
+		cmocka_unit_test(test_cycle_should_execute_instruction_modified_by_fx33),
+		cmocka_unit_test(test_cycle_should_execute_instruction_modified_by_fx55),
+		cmocka_unit_test(test_run_threaded_engine_should_match_table_engine),
+		cmocka_unit_test(test_run_jit_engine_should_match_table_engine),
+		cmocka_unit_test(test_run_jit_engine_should_execute_code_modified_by_fx55),
+		cmocka_unit_test(test_run_should_match_cycle_on_fused_instructions),
+		cmocka_unit_test(test_run_should_execute_fused_instructions_modified_by_fx55),
+		cmocka_unit_test(test_run_should_fast_forward_idle_loops_like_stepping_through_them),
+		cmocka_unit_test(test_run_should_fast_forward_a_jump_to_itself),
+		cmocka_unit_test(test_run_should_wait_for_a_key_on_every_engine),
+		cmocka_unit_test(test_is_halted_should_only_be_true_on_a_jump_to_itself),
+		cmocka_unit_test(test_run_flat_engine_should_match_table_engine),
+		cmocka_unit_test(test_run_flat_engine_should_skip_invalid_opcodes),
+		cmocka_unit_test(test_run_flat_engine_should_execute_code_modified_by_fx55),
+		cmocka_unit_test(test_run_lockstep_should_match_cycle),
+		cmocka_unit_test(test_run_lockstep_should_match_cycle_on_alu_instructions_with_vf_operands),
+		cmocka_unit_test(test_run_lockstep_should_match_cycle_on_key_instructions),
+		cmocka_unit_test(test_frames_take_should_return_null_until_a_frame_is_published),
+		cmocka_unit_test(test_frames_take_should_redraw_every_row_after_a_skipped_frame),
+		cmocka_unit_test(test_frames_back_should_never_be_the_taken_frame),
+		cmocka_unit_test(test_publish_video_should_move_the_dirty_rows_to_the_frame),
+		cmocka_unit_test(test_frames_should_hand_whole_frames_to_another_thread),
+		cmocka_unit_test(test_movie_record_should_only_add_keypad_changes),
+		cmocka_unit_test(test_movie_add_should_reject_events_out_of_order),
+		cmocka_unit_test(test_save_movie_should_round_trip_through_load_movie),
+		cmocka_unit_test(test_load_movie_should_fail_on_a_truncated_or_foreign_file),
+		cmocka_unit_test(test_load_movie_should_replay_a_recording_on_every_engine),
+		cmocka_unit_test(test_load_rom_should_return_an_error_if_the_rom_does_not_exist),
+		cmocka_unit_test(test_load_rom_should_record_the_size_of_the_rom),
+		cmocka_unit_test(test_dump_memory_to_file_should_return_an_error_if_the_file_cannot_be_created),
+		cmocka_unit_test(test_chip8_strerror_should_describe_every_error),
+		cmocka_unit_test(test_run_should_not_share_state_between_chips_on_different_threads),
+		cmocka_unit_test(test_chip8_reset_should_restore_the_pristine_chip),
+		cmocka_unit_test(test_chip8_reset_should_keep_the_decoded_instructions_of_unchanged_pages),
+		cmocka_unit_test(test_chip8_clone_should_branch_like_the_parent),
+		cmocka_unit_test(test_chip8_clone_should_copy_only_the_pages_written_since_the_last_clone),
+		cmocka_unit_test(test_chip8_clone_should_copy_everything_from_another_parent),
+		cmocka_unit_test(test_pool_acquire_should_hand_out_each_chip_once_until_it_is_released),
+		cmocka_unit_test(test_pool_acquire_should_reset_a_released_chip),
+		cmocka_unit_test(test_chip8_load_state_should_resume_like_an_uninterrupted_run),
+		cmocka_unit_test(test_chip8_save_state_file_should_round_trip_through_chip8_load_state_file),
+		cmocka_unit_test(test_chip8_load_state_file_should_leave_the_chip_alone_on_a_foreign_or_truncated_file),
+		cmocka_unit_test(test_chip8_map_state_file_should_start_where_the_saved_chip_was),
+		cmocka_unit_test(test_chip8_map_state_file_should_publish_the_whole_screen_first),
+		cmocka_unit_test(test_chip8_map_state_file_should_fail_on_a_missing_or_foreign_file),
+		cmocka_unit_test(test_rewind_pop_should_go_back_through_every_pushed_frame),
+		cmocka_unit_test(test_rewind_push_should_drop_the_oldest_frames_past_the_budget),
+		cmocka_unit_test(test_rewind_push_should_keep_a_minute_of_frames_under_a_megabyte),
+		cmocka_unit_test(test_load_aot_should_fail_if_library_does_not_exist),
+		cmocka_unit_test(test_run_aot_engine_should_interpret_without_a_recompiled_rom),
+		cmocka_unit_test(test_run_should_tick_timers_once_per_instructions_per_tick),
+		cmocka_unit_test(test_op_fx07_should_read_the_delay_timer_of_the_current_tick),
+		cmocka_unit_test(test_run_should_execute_count_instructions),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,234 @@
+#include <string.h>
+#include "../inc/threaded.h"
+
+#ifdef __GNUC__
+
+#define DISPATCH() \
+	do { \
+		if (!count--) { \
+			chip->instruction_count = first + total; \
+			return; \
+		} \
+		if (chip->pc >= CHIP8_MEMORY_SIZE) { \
+			instruction = &past_memory; \
+			decode_past_memory(chip, instruction); \
+		} else { \
+			instruction = &chip->decoded[chip->pc]; \
+			if (!instruction->handler) { \
+				decode(chip, chip->pc, instruction); \
+			} \
+		} \
+		chip->opcode = instruction->opcode; \
+		chip->pc += 2; \
+		goto *labels[instruction->op]; \
+	} while (0)
+
+// The instruction count is only stored when something can observe it.
+#define SYNC_INSTRUCTION_COUNT() (chip->instruction_count = first + (total - count - 1))
+
+void run_threaded(Chip8* chip, uint32_t count) {
+	static const void* labels[CHIP8_OP_COUNT] = {
+		[CHIP8_OP_NULL] = &&op_invalid,
+		[CHIP8_OP_00E0] = &&op_00e0,
+		[CHIP8_OP_00EE] = &&op_00ee,
+		[CHIP8_OP_1NNN] = &&op_1nnn,
+		[CHIP8_OP_2NNN] = &&op_2nnn,
+		[CHIP8_OP_3XKK] = &&op_3xkk,
+		[CHIP8_OP_4XKK] = &&op_4xkk,
+		[CHIP8_OP_5XY0] = &&op_5xy0,
+		[CHIP8_OP_6XKK] = &&op_6xkk,
+		[CHIP8_OP_7XKK] = &&op_7xkk,
+		[CHIP8_OP_8XY0] = &&op_8xy0,
+		[CHIP8_OP_8XY1] = &&op_8xy1,
+		[CHIP8_OP_8XY2] = &&op_8xy2,
+		[CHIP8_OP_8XY3] = &&op_8xy3,
+		[CHIP8_OP_8XY4] = &&op_8xy4,
+		[CHIP8_OP_8XY5] = &&op_8xy5,
+		[CHIP8_OP_8XY6] = &&op_8xy6,
+		[CHIP8_OP_8XY7] = &&op_8xy7,
+		[CHIP8_OP_8XYE] = &&op_8xye,
+		[CHIP8_OP_9XY0] = &&op_9xy0,
+		[CHIP8_OP_ANNN] = &&op_annn,
+		[CHIP8_OP_BNNN] = &&op_bnnn,
+		[CHIP8_OP_CXKK] = &&op_handler,
+		[CHIP8_OP_DXYN] = &&op_handler,
+		[CHIP8_OP_EX9E] = &&op_ex9e,
+		[CHIP8_OP_EXA1] = &&op_exa1,
+		[CHIP8_OP_FX07] = &&op_fx07,
+		[CHIP8_OP_FX0A] = &&op_handler,
+		[CHIP8_OP_FX15] = &&op_fx15,
+		[CHIP8_OP_FX18] = &&op_fx18,
+		[CHIP8_OP_FX1E] = &&op_fx1e,
+		[CHIP8_OP_FX29] = &&op_fx29,
+		[CHIP8_OP_FX33] = &&op_handler,
+		[CHIP8_OP_FX55] = &&op_handler,
+		[CHIP8_OP_FX65] = &&op_handler,
+	};
+
+	Chip8Instruction past_memory;
+	Chip8Instruction* instruction;
+	uint8_t* v = chip->registers;
+	uint64_t first = chip->instruction_count;
+	uint32_t total = count;
+
+	DISPATCH();
+
+op_invalid:
+	DISPATCH();
+
+op_00e0:
+	memset(chip->video, 0, sizeof(chip->video));
+	chip->dirty_rows = 0xffffffff;
+	DISPATCH();
+
+op_00ee:
+	chip->sp--;
+	chip->pc = chip->stack[chip->sp % CHIP8_STACK_SIZE];
+	DISPATCH();
+
+op_1nnn:
+	chip->pc = instruction->nnn;
+	DISPATCH();
+
+op_2nnn:
+	chip->stack[chip->sp % CHIP8_STACK_SIZE] = chip->pc;
+	chip->sp++;
+	chip->pc = instruction->nnn;
+	DISPATCH();
+
+op_3xkk:
+	if (v[instruction->x] == instruction->kk) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_4xkk:
+	if (v[instruction->x] != instruction->kk) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_5xy0:
+	if (v[instruction->x] == v[instruction->y]) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_6xkk:
+	v[instruction->x] = instruction->kk;
+	DISPATCH();
+
+op_7xkk:
+	v[instruction->x] += instruction->kk;
+	DISPATCH();
+
+op_8xy0:
+	v[instruction->x] = v[instruction->y];
+	DISPATCH();
+
+op_8xy1:
+	v[instruction->x] |= v[instruction->y];
+	DISPATCH();
+
+op_8xy2:
+	v[instruction->x] &= v[instruction->y];
+	DISPATCH();
+
+op_8xy3:
+	v[instruction->x] ^= v[instruction->y];
+	DISPATCH();
+
+op_8xy4: {
+	uint16_t sum = v[instruction->x] + v[instruction->y];
+	v[0xf] = sum > 0xffu;
+	v[instruction->x] = sum & 0x00ffu;
+	DISPATCH();
+}
+
+op_8xy5:
+	v[0xf] = v[instruction->x] > v[instruction->y];
+	v[instruction->x] -= v[instruction->y];
+	DISPATCH();
+
+op_8xy6:
+	v[0xf] = v[instruction->x] & 0x01u;
+	v[instruction->x] >>= 1;
+	DISPATCH();
+
+op_8xy7:
+	v[0xf] = v[instruction->y] > v[instruction->x];
+	v[instruction->x] = v[instruction->y] - v[instruction->x];
+	DISPATCH();
+
+op_8xye:
+	v[0xf] = v[instruction->x] >> 7u;
+	v[instruction->x] <<= 1;
+	DISPATCH();
+
+op_9xy0:
+	if (v[instruction->x] != v[instruction->y]) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_annn:
+	chip->index = instruction->nnn;
+	DISPATCH();
+
+op_bnnn:
+	chip->pc = v[0x0] + instruction->nnn;
+	DISPATCH();
+
+op_ex9e:
+	if (chip->keypad[v[instruction->x] % CHIP8_KEYPAD_SIZE]) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_exa1:
+	if (!chip->keypad[v[instruction->x] % CHIP8_KEYPAD_SIZE]) {
+		chip->pc += 2;
+	}
+	DISPATCH();
+
+op_fx07:
+	SYNC_INSTRUCTION_COUNT();
+	update_timers(chip);
+	v[instruction->x] = chip->delay_timer;
+	DISPATCH();
+
+op_fx15:
+	SYNC_INSTRUCTION_COUNT();
+	update_timers(chip);
+	chip->delay_timer = v[instruction->x];
+	DISPATCH();
+
+op_fx18:
+	SYNC_INSTRUCTION_COUNT();
+	update_timers(chip);
+	chip->sound_timer = v[instruction->x];
+	DISPATCH();
+
+op_fx1e:
+	chip->index += v[instruction->x];
+	DISPATCH();
+
+op_fx29:
+	chip->index = CHIP8_FONT_SET_START_ADDRESS + (5 * v[instruction->x]);
+	DISPATCH();
+
+op_handler:
+	SYNC_INSTRUCTION_COUNT();
+	instruction->handler(chip, instruction);
+	DISPATCH();
+}
+
+#else
+
+void run_threaded(Chip8* chip, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		cycle(chip);
+	}
+}
+
+#endif /* __GNUC__ */